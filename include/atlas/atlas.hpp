@@ -2,6 +2,9 @@
 #define GP_ATLAS_HPP_
 
 #include <memory>
+#include <mutex>
+#include <deque>
+#include <functional>
 #include <unordered_map>
 #include <iostream>
 #include <Eigen/Dense>
@@ -13,6 +16,13 @@ namespace gp_atlas_rrt
 {
     /**
      * \brief Container for a chart
+     *
+     * Center, gradient, tangent basis, radius and variance are fixed once the
+     * chart is stored in an atlas and can be read from any thread. The public
+     * members (samples, their ranking, samp_chosen and the flags) are not
+     * guarded: they belong to the one thread expanding the chart, explorers
+     * never expand a chart from two threads at once, and others only read
+     * them between explorations.
      */
     struct Chart
     {
@@ -22,7 +32,7 @@ namespace gp_atlas_rrt
         //only way to construct a Chart! (also prevents implicit conversions)
         explicit Chart(const Eigen::Vector3d &c, const std::size_t i, const Eigen::Vector3d &g
                 ,const double v):
-            id(i), C(c), G(g), V(v), samp_chosen(-1), expandable(true)
+            samp_chosen(-1), vars_ranked(0), expandable(true), replaced_by(-1), id(i), C(c), G(g), V(v)
         {
             gp_regression::computeTangentBasis(G, N,Tx,Ty);
         }
@@ -82,16 +92,32 @@ namespace gp_atlas_rrt
             return V;
         }
 
+        /**
+         * \brief false once the chart was replaced by one on an updated model
+         */
+        inline bool isValid() const
+        {
+            return replaced_by < 0;
+        }
+
+        /**
+         * \brief release the disc samples, their ranking and the chosen one
+         */
         inline void resetSamples()
         {
             samples.resize(0,0);
+            std::vector<std::pair<double,std::size_t>>().swap(vars_ids);
+            vars_ranked = 0;
+            samp_chosen = -1;
         }
 
         //these can be public, they dont affect the disc functionalites
         Eigen::MatrixXd samples; //collection of uniform disc samples (nx3)
         int samp_chosen; //the chosen sample id, if sampling was not done it is -1
         std::vector<std::pair<double,std::size_t>> vars_ids; //vector of sample variances with their index
+        std::size_t vars_ranked; //the first vars_ranked of vars_ids are the largest, in decreasing order
         bool expandable; //used by AtlasCollision
+        long replaced_by; //id of the chart replacing this one, -1 while valid
 
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
         protected:
@@ -112,7 +138,7 @@ namespace gp_atlas_rrt
 class AtlasBase
 {
     public:
-    AtlasBase(const gp_regression::Model::Ptr &gp, const gp_regression::ThinPlateRegressor::Ptr &reg):
+    AtlasBase(const gp_regression::Model::ConstPtr &gp, const gp_regression::ThinPlateRegressor::ConstPtr &reg):
         gp_model(gp), gp_reg(reg) {}
     virtual ~AtlasBase(){}
 
@@ -125,24 +151,41 @@ class AtlasBase
      */
     virtual inline std::size_t countNodes() const
     {
+        std::lock_guard<std::mutex> lock(nodes_mtx);
         return nodes.size();
     }
     /**
-     * \brief get a copy of a node
+     * \brief get a node, the reference is valid until clear()
+     *
+     * The geometry of a chart never changes once it is stored, its samples
+     * and flags belong to the thread expanding it (see Chart).
      */
-    virtual Chart getNode(const std::size_t &id) const
+    virtual const Chart &getNode(const std::size_t &id) const
     {
+        std::lock_guard<std::mutex> lock(nodes_mtx);
         if (id < nodes.size())
             return nodes.at(id);
         else
             throw gp_regression::GPRegressionException("Out of Range node id");
     }
 
+    /**
+     * \brief release the disc samples of every node, they are drawn again if
+     * a node is expanded later. Not to be called during an exploration.
+     */
+    virtual void releaseSamples()
+    {
+        std::lock_guard<std::mutex> lock(nodes_mtx);
+        for (auto &c: nodes)
+            c.resetSamples();
+    }
+
     /**
      * \brief reset Atlas, clearing contents
      */
     virtual void clear()
     {
+        std::lock_guard<std::mutex> lock(nodes_mtx);
         nodes.clear();
         gp_model.reset();
         gp_reg.reset();
@@ -150,14 +193,21 @@ class AtlasBase
     /**
      * \brief set GP model to use
      */
-    virtual void setGPModel(const gp_regression::Model::Ptr &gpm)
+    virtual void setGPModel(const gp_regression::Model::ConstPtr &gpm)
     {
         gp_model = gpm;
     }
+    /**
+     * \brief GP model in use
+     */
+    virtual inline gp_regression::Model::ConstPtr getGPModel() const
+    {
+        return gp_model;
+    }
     /**
      * \brief set GP regressor to use
      */
-    virtual void setGPRegressor(const gp_regression::ThinPlateRegressor::Ptr &gpr)
+    virtual void setGPRegressor(const gp_regression::ThinPlateRegressor::ConstPtr &gpr)
     {
         gp_reg = gpr;
     }
@@ -181,98 +231,125 @@ class AtlasBase
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     protected:
     ///Pointer to gp_model
-    gp_regression::Model::Ptr gp_model;
+    gp_regression::Model::ConstPtr gp_model;
     ///Pointer to regressor
-    gp_regression::ThinPlateRegressor::Ptr gp_reg;
-    ///Node storage
-    std::vector<Chart> nodes;
+    gp_regression::ThinPlateRegressor::ConstPtr gp_reg;
+    ///Node storage, a deque so that references to a chart survive the
+    ///creation of others
+    std::deque<Chart> nodes;
+    ///Guards the node storage (and whatever is kept in step with it) when
+    ///several explorer threads share the atlas. Each chart instead belongs to
+    ///the thread expanding it, which works on it without holding the lock.
+    mutable std::mutex nodes_mtx;
+
+    /**
+     * \brief reference to a stored chart, stable until clear()
+     */
+    Chart &chartRef(const std::size_t id)
+    {
+        std::lock_guard<std::mutex> lock(nodes_mtx);
+        if (id >= nodes.size())
+            throw gp_regression::GPRegressionException("Out of Range node id");
+        return nodes[id];
+    }
 
     /**
      * \brief project a point on gp surface
      *
+     * Newton steps along the gradient, x -= f(x)*g/|g|^2, the shortest step
+     * zeroing the linearization of f at x, with backtracking until |f|
+     * decreases enough. Every iteration (and every backtracking trial) is a
+     * single evaluation of mean and gradient, the variance is never needed.
+     *
      * \param[in] in Input point to project
-     * \param[out] out projected point on gp, if successful, otherwise untouched.
-     * \paran[in] normal Unnormalized gradient along which projection takes place.
-     * \param[in] step_mul multiplier to step lenght.
-     * \param[in] f_tol tolerance on f(x). First convergence criteria.
-     * \param[in] max_iter total iterations to try before converging. Second convergence criteria.
-     * \param[in] improve_tol tolerance on f(x) improvement. Thired convergence criteria.
+     * \param[out] out projected point on gp, the last iterate if not converged.
+     * \param[in] normal Unnormalized gradient at in, used where the gp gradient is unusable.
+     * \param[in] f_tol tolerance on |f(x)|. Convergence criteria.
+     * \param[in] x_tol tolerance on the step length. Below it the projection stalled.
+     * \param[in] max_iter maximum number of Newton steps.
+     * \param[in] cancelled polled before every step, if it returns true the
+     * projection gives up (and returns false). Empty means never.
+     * \return true if |f(out)| < f_tol
      */
-    virtual void project(const Eigen::Vector3d &in, Eigen::Vector3d &out, const Eigen::Vector3d &normal,
-            const double f_tol= 1e-2, const double improve_tol= 1e-7, const unsigned int max_iter=500, const double step_mul = 0.001)
+    virtual bool project(const Eigen::Vector3d &in, Eigen::Vector3d &out, const Eigen::Vector3d &normal,
+            const double f_tol= 1e-4, const double x_tol= 1e-9, const unsigned int max_iter=50,
+            const std::function<bool()> &cancelled = std::function<bool()>())
     {
         if (!gp_reg)
             throw gp_regression::GPRegressionException("Empty regressor pointer");
-        Eigen::Vector3d current = in;
-        std::vector<double> current_f, v;
-        unsigned int iter = 0;
-        Eigen::MatrixXd N;
+        //sufficient decrease of |f| and number of step halvings
+        const double armijo = 1e-4;
+        const unsigned int max_halvings = 20;
+
+        gp_regression::Data::Ptr query = std::make_shared<gp_regression::Data>();
+        query->coord_x.resize(1);
+        query->coord_y.resize(1);
+        query->coord_z.resize(1);
+        gp_regression::EvalOutput eval;
         Eigen::Vector3d g = normal;
-        while(iter < max_iter)
+        //mean and gradient at x, g is kept when the gradient is unusable
+        auto evaluate = [&](const Eigen::Vector3d &x) -> double
         {
-            // std::cout<<"iter "<<iter<<std::endl;
-            gp_regression::Data::Ptr currentP = std::make_shared<gp_regression::Data>();
-            // clear vectors of current values
-            current_f.clear();
-            v.clear();
-
-            // and fill with current values
-            currentP->coord_x.push_back( current(0) );
-            currentP->coord_y.push_back( current(1) );
-            currentP->coord_z.push_back( current(2) );
-
-            // evaluate the current result
-            gp_reg->evaluate(gp_model, currentP, current_f);
-
-            if (std::isnan(current_f.at(0)) || std::isinf(current_f.at(0))){
+            query->coord_x[0] = x(0);
+            query->coord_y[0] = x(1);
+            query->coord_z[0] = x(2);
+            gp_reg->evaluate<gp_regression::EVAL_MEAN | gp_regression::EVAL_GRAD>(gp_model, query, eval);
+            const double f = eval.f.at(0);
+            if (std::isnan(f) || std::isinf(f)){
                 std::cout << "[Atlas::project] Found NAN function evaluation. Fatal" << std::endl;
-                std::cout<<"current "<<current<<std::endl;
+                std::cout<<"current "<<x<<std::endl;
                 throw gp_regression::GPRegressionException("f is nan or inf");
             }
+            return f;
+        };
+        auto usable = [](const Eigen::Vector3d &grad)
+        {
+            return grad.allFinite() && grad.isMuchSmallerThan(1e3, 1e-1) && !grad.isZero(1e-5);
+        };
 
-            // std::cout << "current f" << current_f.at(0) << std::endl;
-
-            // check tolerances
-            if( std::abs(current_f.at(0)) < f_tol )
-            {
-                std::cout << "[Atlas::project] CONVERGENCE: Function evaluation reached tolerance." << std::endl;
+        Eigen::Vector3d current = in;
+        double f = evaluate(current);
+        if (usable(eval.N.row(0).transpose()))
+            g = eval.N.row(0).transpose();
+        for (unsigned int iter = 0; iter < max_iter; ++iter)
+        {
+            if (std::abs(f) < f_tol){
                 out = current;
-                return;
-            }
-
-            // perform the step using the gradient descent method
-            // put minus in front, cause normals are all pointing outwards
-            Eigen::Vector3d cur_step = step_mul*current_f.at(0)*g;
-            if (!cur_step.isMuchSmallerThan(1e3, 1e-1) || cur_step.isZero(1e-6)){
-                std::cout<<"[Atlas::project] Current step is wrong! Ignoring\n";
-                std::cout<<"[Atlas::project] It was\n"<<cur_step<<std::endl;
+                return true;
             }
-            else
-                current -= cur_step;
-
-            // check improvment tolerance
-            gp_regression::Data::Ptr outP = std::make_shared<gp_regression::Data>();
-            outP->coord_x.push_back( current(0) );
-            outP->coord_y.push_back( current(1) );
-            outP->coord_z.push_back( current(2) );
-            std::vector<double> out_f;
-            gp_reg->evaluate(gp_model, outP, out_f, v, N);
-            if (!N.row(0).isMuchSmallerThan(1e3, 1e-1) || N.row(0).isZero(1e-5)){
-                std::cout<<"[Atlas::project] Gradient is wrong! Resetting to previous\n";
-                std::cout<<"[Atlas::project] Gradient was\n"<<N.row(0)<<std::endl;
+            if (cancelled && cancelled()){
+                out = current;
+                return false;
             }
-            else
-                g = N.row(0);
-            if( std::abs(out_f.at(0) - current_f.at(0)) < improve_tol )
+            const Eigen::Vector3d step = -f*g/g.squaredNorm();
+            double t = 1.0;
+            Eigen::Vector3d next = current + step;
+            double f_next = evaluate(next);
+            unsigned int halvings = 0;
+            while (std::abs(f_next) > (1.0 - armijo*t)*std::abs(f) && halvings < max_halvings)
             {
-                std::cout << "[Atlas::project] CONVERGENCE: Function improvement reached tolerance." << std::endl;
+                t *= 0.5;
+                next = current + t*step;
+                f_next = evaluate(next);
+                ++halvings;
+            }
+            if (t*step.norm() < x_tol || std::abs(f_next) >= std::abs(f)){
+                std::cout << "[Atlas::project] CONVERGENCE: Step length reached tolerance. F: "<<f<< std::endl;
                 out = current;
-                return;
+                return false;
             }
-            ++iter;
+            current = next;
+            f = f_next;
+            if (usable(eval.N.row(0).transpose()))
+                g = eval.N.row(0).transpose();
+        }
+        if (std::abs(f) < f_tol){
+            out = current;
+            return true;
         }
-        std::cout << "[Atlas::project] CONVERGENCE: Reached maximum number of iterations. F: "<<current_f.at(0)<<" Var:"<<v.at(0)<< std::endl;
+        std::cout << "[Atlas::project] CONVERGENCE: Reached maximum number of iterations. F: "<<f<< std::endl;
         out = current;
+        return false;
     }
 
 };
@@ -1,7 +1,11 @@
 #ifndef GP_ATLAS_COLLISION_HPP_
 #define GP_ATLAS_COLLISION_HPP_
 
+#include <algorithm>
+#include <atomic>
+#include <gp_regression/thread_pool.hpp>
 #include <atlas/atlas_variance.hpp>
+#include <atlas/chart_grid.hpp>
 
 namespace gp_atlas_rrt
 {
@@ -13,66 +17,165 @@ class AtlasCollision : public AtlasVariance
     typedef std::shared_ptr<const AtlasCollision> ConstPtr;
 
     AtlasCollision()=delete;
-    AtlasCollision(const gp_regression::Model::Ptr &gp, const gp_regression::ThinPlateRegressor::Ptr &reg):
-        AtlasVariance(gp,reg)
+    AtlasCollision(const gp_regression::Model::ConstPtr &gp, const gp_regression::ThinPlateRegressor::ConstPtr &reg):
+        AtlasVariance(gp,reg), candidates(1)
     {}
     virtual ~AtlasCollision(){}
 
+    virtual void clear()
+    {
+        AtlasVariance::clear();
+        std::lock_guard<std::mutex> lock(nodes_mtx);
+        grid.clear();
+    }
+
+    /**
+     * \brief Create the child of parent at center, the projection of the
+     * parent chosen sample.
+     *
+     * Other threads may have charted that sample since getNextState() found it
+     * free, in that case nothing is created and the parent can be expanded
+     * again (the sample is now in collision). The check and the insertion are
+     * atomic, hence the atlas grows as if the expansions were serial.
+     * \return true if the child was created, its id in child
+     */
+    virtual bool createChild(const Eigen::Vector3d& center, const std::size_t parent, std::size_t &child)
+    {
+        Eigen::Vector3d g;
+        double v;
+        evaluateCenter(center, g, v);
+        std::lock_guard<std::mutex> lock(nodes_mtx);
+        if (parent >= nodes.size())
+            throw gp_regression::GPRegressionException("Out of Range node id");
+        const Chart &p = nodes[parent];
+        if (p.samp_chosen >= 0 && isInCollision(p.samples.row(p.samp_chosen), parent))
+            return false;
+        child = addNode(center, g, v);
+        return true;
+    }
 
+
+    /**
+     * \brief how many of the best collision free samples getNextState()
+     * projects at once, 1 projects only the best one
+     */
+    virtual inline void setSpeculativeCandidates(const std::size_t k)
+    {
+        candidates = std::max<std::size_t>(k, 1);
+    }
+
+    /**
+     * \brief Next state from node id: the projection of its best collision
+     * free sample.
+     *
+     * The best candidates are projected together on the shared ThreadPool.
+     * The best ranked one that converges wins, as soon as one converges the
+     * projections of the worse ranked ones are cancelled. If none converges
+     * there is no point on the surface to chart: Zero is returned and the
+     * candidates are dropped from the ranking, the chart stays expandable and
+     * the next call tries the following samples.
+     */
     virtual Eigen::Vector3d getNextState(const std::size_t& id)
     {
         if (!gp_reg)
             throw gp_regression::GPRegressionException("Empty Regressor pointer");
-        if (id >= nodes.size())
-            throw gp_regression::GPRegressionException("Out of Range node id");
-        if (!nodes[id].expandable)
+        //the chart belongs to the calling thread, only the store is shared
+        Chart &c = chartRef(id);
+        if (!c.expandable)
             return Eigen::Vector3d::Zero();
-        if (nodes.at(id).samp_chosen < 0)
-            sampleOnChart(nodes.at(id));
-        Eigen::Vector3d chosen;
-        chosen.setZero();
-        nodes[id].expandable = false;
-        for (size_t i=0; i<nodes.at(id).vars_ids.size(); ++i)
+        //never sampled, or its samples were released
+        if (c.vars_ids.empty())
+            sampleOnChart(c);
+        std::vector<std::size_t> cands;
         {
-            std::size_t s_id = nodes.at(id).vars_ids[i].second;
-            if (nodes.at(id).samp_chosen == s_id)
-                continue;
-            if (!isInCollision(nodes.at(id).samples.row(s_id), id)){
-                nodes.at(id).samp_chosen = s_id;
-                chosen = nodes.at(id).samples.row(s_id);
-                nodes[id].expandable = true;
-                break;
+            std::lock_guard<std::mutex> lock(nodes_mtx);
+            for (size_t i=0; i<c.vars_ids.size() && cands.size() < candidates; ++i)
+            {
+                //rank more samples only when the best ones are all taken
+                if (i >= c.vars_ranked)
+                    rankSamples(c, 2*i + 1);
+                std::size_t s_id = c.vars_ids[i].second;
+                if (c.samp_chosen == static_cast<int>(s_id))
+                    continue;
+                if (!isInCollision(c.samples.row(s_id), id))
+                    cands.push_back(s_id);
             }
+            c.expandable = !cands.empty();
+            if (!c.expandable)
+                --num_expandables;
         }
-        if (!nodes[id].expandable){
+        if (!c.expandable){
             std::cout<<"[Atlas::getNextState] No viable extending direction found, cannot extend the node"<<std::endl;
-            --num_expandables;
+            //the samples are of no use anymore
+            c.resetSamples();
+            return Eigen::Vector3d::Zero();
+        }
+        const Eigen::Vector3d G = c.getGradient();
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> nextStates(cands.size());
+        //best ranked candidate converged so far
+        std::atomic<std::size_t> best(cands.size());
+        auto projectCandidate = [&](const std::size_t k)
+        {
+            const Eigen::Vector3d chosen = c.samples.row(cands[k]);
+            if (!project(chosen, nextStates[k], G, 1e-4, 1e-9, 50, [&best, k](){ return best < k; }))
+                return;
+            std::size_t b = best;
+            while (k < b && !best.compare_exchange_weak(b, k));
+        };
+        if (cands.size() == 1)
+            projectCandidate(0);
+        else
+            gp_regression::ThreadPool::shared().parallelFor(cands.size(), projectCandidate);
+        const std::size_t k = best;
+        if (k == cands.size()){
+            std::cout<<"[Atlas::getNextState] No candidate reached the surface, trying others next time"<<std::endl;
+            for (std::size_t i=0; i<c.vars_ranked; )
+                if (std::find(cands.begin(), cands.end(), c.vars_ids[i].second) != cands.end()){
+                    c.vars_ids.erase(c.vars_ids.begin() + i);
+                    --c.vars_ranked;
+                }
+                else
+                    ++i;
+            //with no samples left the next call would sample the disc all over again
+            if (c.vars_ids.empty()){
+                std::lock_guard<std::mutex> lock(nodes_mtx);
+                c.expandable = false;
+                --num_expandables;
+                c.resetSamples();
+            }
             return Eigen::Vector3d::Zero();
         }
-        Eigen::Vector3d nextState;
-        const Eigen::Vector3d G = nodes.at(id).getGradient();
-        //project the chosen
-        project(chosen, nextState, G);
+        c.samp_chosen = cands[k];
         //and done
-        return nextState;
+        return nextStates[k];
     }
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     protected:
-    //true if collision found
+    //discs of the valid charts, kept in step with nodes by addNode and replaceNode
+    ChartGrid grid;
+    //samples projected at once by getNextState()
+    std::size_t candidates;
+
+    virtual std::size_t addNode(const Eigen::Vector3d& center, const Eigen::Vector3d &g, const double v)
+    {
+        const std::size_t id = AtlasVariance::addNode(center, g, v);
+        grid.insert(nodes[id].getCenter(), nodes[id].getRadius(), id);
+        return id;
+    }
+
+    //a replaced chart leaves the grid, its replacement enters it
+    virtual std::size_t replaceNode(const std::size_t old, const Eigen::Vector3d& center,
+            const Eigen::Vector3d &g, const double v)
+    {
+        grid.erase(nodes.at(old).getCenter(), nodes.at(old).getRadius(), old);
+        return AtlasVariance::replaceNode(old, center, g, v);
+    }
+
+    //true if collision found, nodes_mtx must be held
     virtual bool isInCollision(const Eigen::Vector3d &pt, const std::size_t &self)
     {
-        for (std::size_t i=0; i<nodes.size(); ++i)
-        {
-            if (i == self)
-                continue;
-            const double dist = (pt[0] - nodes[i].getCenter()[0])*(pt[0] - nodes[i].getCenter()[0]) +
-                                (pt[1] - nodes[i].getCenter()[1])*(pt[1] - nodes[i].getCenter()[1]) +
-                                (pt[2] - nodes[i].getCenter()[2])*(pt[2] - nodes[i].getCenter()[2]);
-            if (dist <= std::pow(nodes[i].getRadius(),2))
-                return true;
-        }
-        return false;
+        return grid.collides(pt, self);
     }
 };
 }
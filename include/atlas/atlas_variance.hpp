@@ -1,6 +1,7 @@
 #ifndef GP_ATLAS_VARIANCE_HPP_
 #define GP_ATLAS_VARIANCE_HPP_
 
+#include <algorithm>
 #include <atlas/atlas.hpp>
 
 namespace gp_atlas_rrt
@@ -13,8 +14,9 @@ class AtlasVariance : public AtlasBase
     typedef std::shared_ptr<const AtlasVariance> ConstPtr;
 
     AtlasVariance()=delete;
-    AtlasVariance(const gp_regression::Model::Ptr &gp, const gp_regression::ThinPlateRegressor::Ptr &reg):
-        AtlasBase(gp,reg), var_factor(0.3), disc_samples_factor(200)
+    AtlasVariance(const gp_regression::Model::ConstPtr &gp, const gp_regression::ThinPlateRegressor::ConstPtr &reg):
+        AtlasBase(gp,reg), var_factor(0.3), disc_samples_factor(200), ranked_samples(16),
+        quasi_random(false), adaptive(false), sweep_samples(16), adaptive_tol(1e-4)
     {
         var_tol = 0.5; //this should be give by user
                        //whoever uses this class will take care of it, by calling
@@ -39,6 +41,31 @@ class AtlasVariance : public AtlasBase
         disc_samples_factor = dsf;
     }
 
+    /**
+     * \brief draw disc samples from a randomly shifted Halton sequence
+     * instead of independently, they cover the annulus more evenly, hence
+     * fewer of them (a smaller disc sample factor) are needed
+     */
+    virtual inline void setQuasiRandomSampling(const bool qr)
+    {
+        quasi_random = qr;
+    }
+
+    /**
+     * \brief search the disc for its largest variance instead of sampling it
+     *
+     * A sweep of sweep angles on the annulus, then a golden section search
+     * in the sectors of the best local maxima, stopped once what is left to
+     * gain in a sector is below tol. Every evaluated point is kept as a
+     * disc sample, the sweep is the fallback when the maxima collide.
+     */
+    virtual inline void setAdaptiveSampling(const bool a, const std::size_t sweep = 16, const double tol = 1e-4)
+    {
+        adaptive = a;
+        sweep_samples = std::max<std::size_t>(sweep, 3);
+        adaptive_tol = tol;
+    }
+
     // ///reset Atlas with new parameters and then recieve a new starting point (root)
     // virtual void init(const double var_tolerance, const gp_regression::Model::Ptr &gpm, const gp_regression::ThinPlateRegressor::Ptr &gpr)
     // {
@@ -66,6 +93,181 @@ class AtlasVariance : public AtlasBase
     }
 
     virtual std::size_t createNode(const Eigen::Vector3d& center)
+    {
+        Eigen::Vector3d g;
+        double v;
+        evaluateCenter(center, g, v);
+        std::lock_guard<std::mutex> lock(nodes_mtx);
+        return addNode(center, g, v);
+    }
+
+
+    virtual Eigen::Vector3d getNextState(const std::size_t& id)
+    {
+        if (!gp_reg)
+            throw gp_regression::GPRegressionException("Empty Regressor pointer");
+        Chart &c = chartRef(id);
+        //the winner is:
+        sampleOnChart(c);
+        c.samp_chosen = c.vars_ids.at(0).second;
+        Eigen::Vector3d chosen = c.samples.row(c.samp_chosen);
+        // std::cout<<"chosen "<<chosen<<" s_idx "<<s_idx<<std::endl;
+        // std::cout<<"samples dim: "<<c.samples.rows()<<" x "<<c.samples.cols()<<std::endl;
+        // std::cout<<"samples "<<c.samples<<std::endl;
+        Eigen::Vector3d nextState;
+        const Eigen::Vector3d G = c.getGradient();
+        //project the chosen
+        project(chosen, nextState, G);
+        //and done
+        return nextState;
+    }
+
+    /**
+     * \brief Move the atlas to an updated model, keeping the charts which are
+     * still valid.
+     *
+     * All valid chart centers are evaluated on gp at once. A chart is
+     * refreshed when its disc is closer than influence to one of the fresh
+     * points, or when its center moved off the surface, or its variance
+     * changed, by more than tol. Charts are never modified in place:
+     * refreshing projects the center on the new surface and appends a new
+     * chart there, the old one is marked replaced (see Chart::replaced_by) and
+     * is neither expandable nor a solution anymore. Charts overlapping the
+     * refreshed discs (old or new) are expandable again.
+     * The projections run without holding the node storage.
+     * Not to be called during an exploration.
+     *
+     * \param[in] gp the updated model, same regressor and normalization
+     * \param[in] fresh training points added since the model of the atlas
+     * \param[in] influence distance from the fresh points affecting a chart
+     * \param[in] tol tolerance on the mean and variance at chart centers
+     * \return the number of refreshed charts
+     */
+    virtual std::size_t revalidate(const gp_regression::Model::ConstPtr &gp,
+            const gp_regression::Data::ConstPtr &fresh, const double influence, const double tol)
+    {
+        if (!gp_reg)
+            throw gp_regression::GPRegressionException("Empty Regressor pointer");
+        //the valid charts, copied out of the storage
+        std::vector<std::size_t> ids;
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> centers, gradients;
+        std::vector<double> radii, variances;
+        {
+            std::lock_guard<std::mutex> lock(nodes_mtx);
+            gp_model = gp;
+            for (const auto &c: nodes)
+                if (c.isValid()){
+                    ids.push_back(c.getId());
+                    centers.push_back(c.getCenter());
+                    gradients.push_back(c.getGradient());
+                    radii.push_back(c.getRadius());
+                    variances.push_back(c.getVariance());
+                }
+        }
+        if (ids.empty())
+            return 0;
+        gp_regression::Data::Ptr query = std::make_shared<gp_regression::Data>();
+        for (const auto &C: centers)
+        {
+            query->coord_x.push_back(C(0));
+            query->coord_y.push_back(C(1));
+            query->coord_z.push_back(C(2));
+        }
+        gp_regression::EvalOutput out;
+        gp_reg->evaluate<gp_regression::EVAL_MEAN | gp_regression::EVAL_VAR>(gp_model, query, out);
+        //new center, gradient and variance of the refreshed charts
+        std::vector<std::size_t> refresh_ids;
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> new_centers, new_gradients;
+        std::vector<double> new_variances;
+        const std::size_t n_fresh = fresh ? fresh->coord_x.size() : 0;
+        for (std::size_t i=0; i<ids.size(); ++i)
+        {
+            bool refresh = std::abs(out.f[i]) > tol || std::abs(out.v[i] - variances[i]) > tol;
+            for (std::size_t j=0; j<n_fresh && !refresh; ++j)
+            {
+                const Eigen::Vector3d p(fresh->coord_x[j], fresh->coord_y[j], fresh->coord_z[j]);
+                refresh = (p - centers[i]).norm() < influence + radii[i];
+            }
+            if (!refresh)
+                continue;
+            Eigen::Vector3d center, g;
+            double v;
+            if (!project(centers[i], center, gradients[i]))
+                std::cout<<"[Atlas::revalidate] Chart "<<ids[i]<<" could not be projected on the new surface"<<std::endl;
+            evaluateCenter(center, g, v);
+            refresh_ids.push_back(i);
+            new_centers.push_back(center);
+            new_gradients.push_back(g);
+            new_variances.push_back(v);
+        }
+        if (refresh_ids.empty())
+            return 0;
+        std::lock_guard<std::mutex> lock(nodes_mtx);
+        //old and new discs of the refreshed charts
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> moved;
+        std::vector<double> moved_r;
+        std::size_t refreshed = 0;
+        for (std::size_t k=0; k<refresh_ids.size(); ++k)
+        {
+            const std::size_t i = refresh_ids[k];
+            const std::size_t id = replaceNode(ids[i], new_centers[k], new_gradients[k], new_variances[k]);
+            moved.push_back(centers[i]);
+            moved_r.push_back(radii[i]);
+            moved.push_back(nodes[id].getCenter());
+            moved_r.push_back(nodes[id].getRadius());
+            ++refreshed;
+        }
+        //overlapping charts might have room again, and their samples were
+        //ranked on the old model
+        num_expandables = 0;
+        for (auto &c: nodes)
+        {
+            if (!c.isValid())
+                continue;
+            for (std::size_t j=0; j<moved.size(); ++j)
+                if ((moved[j] - c.getCenter()).norm() < moved_r[j] + c.getRadius()){
+                    c.resetSamples();
+                    c.expandable = true;
+                    break;
+                }
+            num_expandables += c.expandable;
+        }
+        std::cout<<"[Atlas::revalidate] Refreshed "<<refreshed<<" of "<<ids.size()<<" charts"<<std::endl;
+        return refreshed;
+    }
+
+    virtual inline bool isSolution(const std::size_t &id)
+    {
+        std::lock_guard<std::mutex> lock(nodes_mtx);
+        if (id >= nodes.size())
+            throw gp_regression::GPRegressionException("Out of Range node id");
+        return (nodes[id].isValid() && nodes[id].getVariance() > var_tol);
+    }
+
+    std::size_t num_expandables;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    protected:
+    //radius is inversely proportional to variance
+    double var_factor;
+    //how many disc samples multiplier (total samples are proportional to radius)
+    //which in turn is proportional to variance
+    std::size_t disc_samples_factor;
+    //how many of the best disc samples are ranked right away, the rest on demand
+    std::size_t ranked_samples;
+    //variance threshold for solution
+    double var_tol;
+    //disc samples from a low discrepancy sequence
+    bool quasi_random;
+    //adaptive search of the disc, its sweep size and improvement tolerance
+    bool adaptive;
+    std::size_t sweep_samples;
+    double adaptive_tol;
+
+    /**
+     * \brief gradient and variance of a new chart centered at center, the
+     * node storage is not touched
+     */
+    void evaluateCenter(const Eigen::Vector3d& center, Eigen::Vector3d &g, double &v) const
     {
         if (!gp_reg)
             throw gp_regression::GPRegressionException("Empty Regressor pointer");
@@ -73,10 +275,10 @@ class AtlasVariance : public AtlasBase
         c->coord_x.push_back(center(0));
         c->coord_y.push_back(center(1));
         c->coord_z.push_back(center(2));
-        std::vector<double> f,v;
+        std::vector<double> f,vv;
         Eigen::MatrixXd gg;
-        gp_reg->evaluate(gp_model, c, f, v, gg);
-        Eigen::Vector3d g = gg.row(0);
+        gp_reg->evaluate(gp_model, c, f, vv, gg);
+        g = gg.row(0);
         if (g.isZero(1e-3) || !g.isMuchSmallerThan(1e3,1e-1)){
             std::cout<<"[Atlas::createNode] Chart gradient is wrong, trying to perturbate test point.\n";
             std::cout<<"[Atlas::createNode] Gradient is\n"<<g<<std::endl;
@@ -85,7 +287,7 @@ class AtlasVariance : public AtlasBase
             c->coord_x.push_back(center(0) + getRandIn(1e-3, 1e-2));
             c->coord_y.push_back(center(1) + getRandIn(1e-3, 1e-2));
             c->coord_z.push_back(center(2) + getRandIn(1e-3, 1e-2));
-            gp_reg->evaluate(gp_model, c, f, v, gg);
+            gp_reg->evaluate(gp_model, c, f, vv, gg);
             g=gg.row(0);
             // throw gp_regression::GPRegressionException("Gradient is zero");
         }
@@ -96,126 +298,257 @@ class AtlasVariance : public AtlasBase
             std::cout<<"[Atlas::createNode] Gradient was\n"<<g<<std::endl;
             g = Eigen::Vector3d::UnitX();
         }
-        Chart node (center, nodes.size(), g, v.at(0));
-        node.setRadius(computeRadiusFromVariance(v.at(0)));
+        v = vv.at(0);
+    }
+
+    /**
+     * \brief store a chart evaluated by evaluateCenter(), nodes_mtx must be held
+     * \return its id
+     */
+    virtual std::size_t addNode(const Eigen::Vector3d& center, const Eigen::Vector3d &g, const double v)
+    {
+        Chart node (center, nodes.size(), g, v);
+        node.setRadius(computeRadiusFromVariance(v));
         nodes.push_back(node);
         ++num_expandables;
         std::cout<<"[Atlas::createNode] Created node "<<node.getId()<<std::endl;
         return node.getId();
     }
 
-
-    virtual Eigen::Vector3d getNextState(const std::size_t& id)
+    /**
+     * \brief store the chart replacing node old, evaluated by
+     * evaluateCenter(), and mark old as replaced. nodes_mtx must be held
+     * \return the id of the new chart
+     */
+    virtual std::size_t replaceNode(const std::size_t old, const Eigen::Vector3d& center,
+            const Eigen::Vector3d &g, const double v)
     {
-        if (!gp_reg)
-            throw gp_regression::GPRegressionException("Empty Regressor pointer");
-        if (id >= nodes.size())
-            throw gp_regression::GPRegressionException("Out of Range node id");
-        //the winner is:
-        sampleOnChart(nodes.at(id));
-        nodes.at(id).samp_chosen = nodes.at(id).vars_ids.at(0).second;
-        Eigen::Vector3d chosen = nodes.at(id).samples.row(nodes.at(id).samp_chosen);
-        // std::cout<<"chosen "<<chosen<<" s_idx "<<s_idx<<std::endl;
-        // std::cout<<"samples dim: "<<nodes.at(id).samples.rows()<<" x "<<nodes.at(id).samples.cols()<<std::endl;
-        // std::cout<<"samples "<<nodes.at(id).samples<<std::endl;
-        Eigen::Vector3d nextState;
-        const Eigen::Vector3d G = nodes.at(id).getGradient();
-        //project the chosen
-        project(chosen, nextState, G);
-        //and done
-        return nextState;
+        const std::size_t id = addNode(center, g, v);
+        Chart &c = nodes.at(old);
+        c.replaced_by = id;
+        c.expandable = false;
+        c.resetSamples();
+        return id;
     }
 
-    virtual inline bool isSolution(const std::size_t &id)
+    /**
+     * \brief makes sure the first k entries of c.vars_ids are the k largest
+     * variances, in decreasing order. The rest is left unsorted.
+     */
+    void rankSamples(Chart &c, std::size_t k) const
     {
-        if (id >= nodes.size())
-            throw gp_regression::GPRegressionException("Out of Range node id");
-        return (getNode(id).getVariance() > var_tol);
+        k = std::min(k, c.vars_ids.size());
+        if (k <= c.vars_ranked)
+            return;
+        //the ranked prefix already holds the largest ones
+        std::partial_sort(c.vars_ids.begin() + c.vars_ranked, c.vars_ids.begin() + k, c.vars_ids.end(),
+                [](const std::pair<double,std::size_t> &a, const std::pair<double,std::size_t> &b)
+                {
+                    return (a.first > b.first);
+                });
+        c.vars_ranked = k;
     }
 
-    std::size_t num_expandables;
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-    protected:
-    //radius is inversely proportional to variance
-    double var_factor;
-    //how many disc samples multiplier (total samples are proportional to radius)
-    //which in turn is proportional to variance
-    std::size_t disc_samples_factor;
-    //variance threshold for solution
-    double var_tol;
-
     virtual void sampleOnChart(Chart& c)
     {
+        if (adaptive){
+            searchOnChart(c);
+            return;
+        }
         //get some useful constants from the disc
-        const Eigen::Vector3d N = c.getNormal();
         const Eigen::Vector3d Tx = c.getTanBasisOne();
         const Eigen::Vector3d Ty = c.getTanBasisTwo();
         const Eigen::Vector3d C = c.getCenter();
         const double R = c.getRadius();
-        // std::cout<<"N\n"<<N <<std::endl;
-        // std::cout<<"Tx\n"<<Tx <<std::endl;
-        // std::cout<<"Ty\n"<<Ty <<std::endl;
-        // std::cout<<"C\n"<<C <<std::endl;
-        // std::cout<<"G\n"<<G <<std::endl;
-        // std::cout<<"R "<<R <<std::endl;
         //prepare the samples storage
-        const std::size_t tot_samples = std::ceil(std::abs(disc_samples_factor) * R);
-        // std::cout<<"total samples "<<tot_samples<<std::endl;
+        const std::size_t tot_samples = std::ceil(disc_samples_factor * R);
         c.samples.resize(tot_samples, 3);
         c.vars_ids.clear();
-        std::vector<double> f,v;
-        //transformation into the kinect frame from local
-        Eigen::Matrix4d Tkl;
-        Tkl <<  Tx(0), Ty(0), N(0), C(0),
-                Tx(1), Ty(1), N(1), C(1),
-                Tx(2), Ty(2), N(2), C(2),
-                0,     0,     0,    1;
-        // std::cout<<"Tkl "<<Tkl<<std::endl;
-        //uniform annulus sampling
+        c.vars_ranked = 0;
+        //uniform annulus sampling, in the local frame (Tx, Ty) around C
+        gp_regression::Data::Ptr query = std::make_shared<gp_regression::Data>();
+        query->coord_x.resize(tot_samples);
+        query->coord_y.resize(tot_samples);
+        query->coord_z.resize(tot_samples);
+        //Cranley-Patterson rotation, each chart gets its own Halton points
+        const double shift_r = quasi_random ? getRandIn(0.0, 1.0) : 0.0;
+        const double shift_th = quasi_random ? getRandIn(0.0, 1.0) : 0.0;
         for (std::size_t i=0; i<tot_samples; ++i)
         {
-            double r = getRandIn(0.8, 1.0, true);
-            double th = getRandIn(0.0, 2*M_PI);
-            if (std::isnan(r) || std::isinf(r) || std::isnan(th) || std::isinf(th)){
-                std::cout<<"r: "<<r <<"th: "<<th <<std::endl;
+            double r, th;
+            if (quasi_random){
+                r = 0.8 + 0.2*std::fmod(halton(i+1, 2) + shift_r, 1.0);
+                th = 2*M_PI*std::fmod(halton(i+1, 3) + shift_th, 1.0);
+            }
+            else{
                 r = getRandIn(0.8, 1.0, true);
                 th = getRandIn(0.0, 2*M_PI);
             }
-            //point in local frame, uniformely sampled
-            Eigen::Vector4d pL;
-            pL <<   R * std::sqrt(r) * std::cos(th),
-                    R * std::sqrt(r) * std::sin(th),
-                    0,
-                    1;
             //the same point in kinect frame
-            Eigen::Vector4d pK = Tkl * pL;
-            gp_regression::Data::Ptr query = std::make_shared<gp_regression::Data>();
-            query->coord_x.push_back(pK(0));
-            query->coord_y.push_back(pK(1));
-            query->coord_z.push_back(pK(2));
+            const Eigen::Vector3d pK = C + R*std::sqrt(r)*(std::cos(th)*Tx + std::sin(th)*Ty);
             //store the sample for future use (even plotting)
-            c.samples(i,0) = pK(0);
-            c.samples(i,1) = pK(1);
-            c.samples(i,2) = pK(2);
-            //evaluate the sample
-            gp_reg->evaluate(gp_model, query, f, v);
-            if (std::isnan(v.at(0)) || std::isinf(v.at(0)) ||
-                    std::isnan(f.at(0)) || std::isinf(f.at(0))){
-                std::cout << "[Atlas::getNextState] Found NAN. Fatal. f=" <<f.at(0)<<" v=" <<v.at(0)<<std::endl;
-                std::cout<<"point: "<<pK <<std::endl;
-                std::cout<<"point Local: "<<pL <<std::endl;
-                std::cout<<"r: "<<r <<"th: "<<th <<std::endl;
-                std::cout<<"Tkl:\n"<<Tkl <<std::endl;
+            c.samples.row(i) = pK;
+            query->coord_x[i] = pK(0);
+            query->coord_y[i] = pK(1);
+            query->coord_z[i] = pK(2);
+        }
+        if (tot_samples == 0)
+            return;
+        //evaluate all the samples at once, only the variance is needed
+        gp_regression::EvalOutput out;
+        gp_reg->evaluate<gp_regression::EVAL_VAR>(gp_model, query, out);
+        c.vars_ids.reserve(tot_samples);
+        for (std::size_t i=0; i<tot_samples; ++i)
+        {
+            if (std::isnan(out.v[i]) || std::isinf(out.v[i])){
+                std::cout << "[Atlas::getNextState] Found NAN. Fatal. v=" <<out.v[i]<<std::endl;
+                std::cout<<"point: "<<c.samples.row(i) <<std::endl;
+                std::cout<<"center: "<<C.transpose() <<" radius: "<<R <<std::endl;
                 throw gp_regression::GPRegressionException("v is nan or inf");
             }
             //keep variances and ids
-            c.vars_ids.push_back(std::make_pair(v.at(0), i));
+            c.vars_ids.push_back(std::make_pair(out.v[i], i));
         }
-        std::sort(c.vars_ids.begin(), c.vars_ids.end(),
-                [](const std::pair<double,std::size_t> &a, const std::pair<double,std::size_t> &b)
+        rankSamples(c, ranked_samples);
+    }
+
+    /**
+     * \brief adaptive search of the largest variance on the disc annulus, see
+     * setAdaptiveSampling(). Fills the chart samples as sampleOnChart().
+     */
+    void searchOnChart(Chart& c)
+    {
+        const Eigen::Vector3d Tx = c.getTanBasisOne();
+        const Eigen::Vector3d Ty = c.getTanBasisTwo();
+        const Eigen::Vector3d C = c.getCenter();
+        //the circle splitting the annulus area in two
+        const double rho = c.getRadius()*std::sqrt(0.9);
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> points;
+        std::vector<double> vars;
+        //variances at angles, in one evaluation
+        auto evaluate = [&](const std::vector<double> &th) -> std::vector<double>
+        {
+            if (th.empty())
+                return std::vector<double>();
+            gp_regression::Data::Ptr query = std::make_shared<gp_regression::Data>();
+            for (const double t: th)
+            {
+                const Eigen::Vector3d pK = C + rho*(std::cos(t)*Tx + std::sin(t)*Ty);
+                query->coord_x.push_back(pK(0));
+                query->coord_y.push_back(pK(1));
+                query->coord_z.push_back(pK(2));
+                points.push_back(pK);
+            }
+            gp_regression::EvalOutput out;
+            gp_reg->evaluate<gp_regression::EVAL_VAR>(gp_model, query, out);
+            for (const double v: out.v)
+                if (std::isnan(v) || std::isinf(v)){
+                    std::cout << "[Atlas::getNextState] Found NAN. Fatal. v=" <<v<<std::endl;
+                    std::cout<<"center: "<<C.transpose() <<" radius: "<<c.getRadius() <<std::endl;
+                    throw gp_regression::GPRegressionException("v is nan or inf");
+                }
+            vars.insert(vars.end(), out.v.begin(), out.v.end());
+            return out.v;
+        };
+        //coarse sweep, randomly rotated
+        const std::size_t m = sweep_samples;
+        const double step = 2*M_PI/m;
+        const double offset = getRandIn(0.0, step);
+        std::vector<double> th(m);
+        for (std::size_t i=0; i<m; ++i)
+            th[i] = offset + i*step;
+        const std::vector<double> sweep = evaluate(th);
+        //golden section in the sectors of the (up to 3) best local maxima,
+        //unless the disc is flat
+        const double golden = 0.5*(std::sqrt(5.0) - 1.0);
+        struct Sector
+        {
+            double a, b, x1, x2, f1, f2;
+            bool left; //x1 was the last point moved
+        };
+        std::vector<Sector> sectors;
+        std::vector<std::size_t> maxima;
+        for (std::size_t i=0; i<m; ++i)
+            if (sweep[i] >= sweep[(i+m-1)%m] && sweep[i] >= sweep[(i+1)%m])
+                maxima.push_back(i);
+        std::sort(maxima.begin(), maxima.end(), [&sweep](const std::size_t a, const std::size_t b)
                 {
-                    return (a.first > b.first);
+                    return (sweep[a] > sweep[b]);
                 });
+        const auto range = std::minmax_element(sweep.begin(), sweep.end());
+        if (*range.second - *range.first > adaptive_tol)
+            for (std::size_t k=0; k<maxima.size() && k<3; ++k)
+            {
+                Sector s;
+                s.a = th[maxima[k]] - step;
+                s.b = th[maxima[k]] + step;
+                s.x1 = s.b - golden*(s.b - s.a);
+                s.x2 = s.a + golden*(s.b - s.a);
+                sectors.push_back(s);
+            }
+        th.clear();
+        for (const auto &s: sectors)
+        {
+            th.push_back(s.x1);
+            th.push_back(s.x2);
+        }
+        std::vector<double> f = evaluate(th);
+        for (std::size_t k=0; k<sectors.size(); ++k)
+        {
+            sectors[k].f1 = f[2*k];
+            sectors[k].f2 = f[2*k+1];
+        }
+        //one evaluation per iteration, for all the sectors still improving:
+        //a sector stops when its two inner points differ less than the
+        //tolerance, the rest of its bracket cannot do much better
+        for (unsigned int iter=0; iter<20; ++iter)
+        {
+            std::vector<Sector> improving;
+            for (const auto &s: sectors)
+                if (std::abs(s.f1 - s.f2) > adaptive_tol)
+                    improving.push_back(s);
+            sectors.swap(improving);
+            if (sectors.empty())
+                break;
+            th.clear();
+            for (auto &s: sectors)
+            {
+                if (s.f1 > s.f2){
+                    s.b = s.x2;
+                    s.x2 = s.x1;
+                    s.f2 = s.f1;
+                    s.x1 = s.b - golden*(s.b - s.a);
+                    s.left = true;
+                    th.push_back(s.x1);
+                }
+                else{
+                    s.a = s.x1;
+                    s.x1 = s.x2;
+                    s.f1 = s.f2;
+                    s.x2 = s.a + golden*(s.b - s.a);
+                    s.left = false;
+                    th.push_back(s.x2);
+                }
+            }
+            f = evaluate(th);
+            for (std::size_t k=0; k<sectors.size(); ++k)
+            {
+                if (sectors[k].left)
+                    sectors[k].f1 = f[k];
+                else
+                    sectors[k].f2 = f[k];
+            }
+        }
+        c.samples.resize(points.size(), 3);
+        c.vars_ids.clear();
+        c.vars_ids.reserve(points.size());
+        c.vars_ranked = 0;
+        for (std::size_t i=0; i<points.size(); ++i)
+        {
+            c.samples.row(i) = points[i];
+            c.vars_ids.push_back(std::make_pair(vars[i], i));
+        }
+        rankSamples(c, ranked_samples);
     }
 };
 }
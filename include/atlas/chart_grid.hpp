@@ -0,0 +1,157 @@
+#ifndef GP_ATLAS_CHART_GRID_HPP_
+#define GP_ATLAS_CHART_GRID_HPP_
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <Eigen/Core>
+
+namespace gp_atlas_rrt
+{
+/**
+ * \brief Uniform hash grid over chart discs, seen as balls (center, radius)
+ *
+ * Every ball is stored in all the cells its bounding box touches, so a point
+ * only has to be tested against the balls of its own cell. Each cell keeps
+ * its balls as separate coordinate arrays, the test is a branch free loop.
+ * Cells about as large as the typical radius keep both the copies per ball
+ * and the balls per cell small.
+ */
+class ChartGrid
+{
+    public:
+    explicit ChartGrid(const double cell_size = 0.2):
+        cell(cell_size), inv_cell(1.0/cell_size), balls(0)
+    {}
+
+    /**
+     * \brief add the ball of chart id
+     *
+     * Only radius*radius enters the test, so a negative radius (the variance
+     * radius law gives one for large variances) is a ball of radius |radius|.
+     */
+    void insert(const Eigen::Vector3d &center, const double radius, const std::size_t id)
+    {
+        const Eigen::Vector3i lo = cellOf(center.array() - std::abs(radius));
+        const Eigen::Vector3i hi = cellOf(center.array() + std::abs(radius));
+        for (int i = lo[0]; i <= hi[0]; ++i)
+            for (int j = lo[1]; j <= hi[1]; ++j)
+                for (int k = lo[2]; k <= hi[2]; ++k)
+                {
+                    Cell &c = cells[key(i, j, k)];
+                    c.x.push_back(center[0]);
+                    c.y.push_back(center[1]);
+                    c.z.push_back(center[2]);
+                    c.r2.push_back(radius*radius);
+                    c.id.push_back(id);
+                }
+        ++balls;
+    }
+
+    /**
+     * \brief remove the ball of chart id, as it was inserted
+     */
+    void erase(const Eigen::Vector3d &center, const double radius, const std::size_t id)
+    {
+        const Eigen::Vector3i lo = cellOf(center.array() - std::abs(radius));
+        const Eigen::Vector3i hi = cellOf(center.array() + std::abs(radius));
+        bool found = false;
+        for (int i = lo[0]; i <= hi[0]; ++i)
+            for (int j = lo[1]; j <= hi[1]; ++j)
+                for (int k = lo[2]; k <= hi[2]; ++k)
+                {
+                    const auto it = cells.find(key(i, j, k));
+                    if (it == cells.end())
+                        continue;
+                    Cell &c = it->second;
+                    for (std::size_t b = 0; b < c.id.size(); ++b)
+                        if (c.id[b] == id){
+                            //order within a cell does not matter
+                            c.x[b] = c.x.back();
+                            c.y[b] = c.y.back();
+                            c.z[b] = c.z.back();
+                            c.r2[b] = c.r2.back();
+                            c.id[b] = c.id.back();
+                            c.x.pop_back();
+                            c.y.pop_back();
+                            c.z.pop_back();
+                            c.r2.pop_back();
+                            c.id.pop_back();
+                            found = true;
+                            break;
+                        }
+                    if (c.id.empty())
+                        cells.erase(it);
+                }
+        if (found)
+            --balls;
+    }
+
+    /**
+     * \brief true if pt is inside (or on) the ball of any chart but self
+     */
+    bool collides(const Eigen::Vector3d &pt, const std::size_t self) const
+    {
+        const Eigen::Vector3i c = cellOf(pt.array());
+        const auto it = cells.find(key(c[0], c[1], c[2]));
+        if (it == cells.end())
+            return false;
+        const Cell &b = it->second;
+        const std::size_t n = b.id.size();
+        int hit = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const double dx = pt[0] - b.x[i];
+            const double dy = pt[1] - b.y[i];
+            const double dz = pt[2] - b.z[i];
+            hit |= (dx*dx + dy*dy + dz*dz <= b.r2[i]) & (b.id[i] != self);
+        }
+        return hit;
+    }
+
+    void clear()
+    {
+        cells.clear();
+        balls = 0;
+    }
+
+    inline std::size_t size() const
+    {
+        return balls;
+    }
+
+    inline double getCellSize() const
+    {
+        return cell;
+    }
+
+    protected:
+    struct Cell
+    {
+        std::vector<double> x, y, z, r2;
+        std::vector<std::size_t> id;
+    };
+
+    double cell;
+    double inv_cell;
+    std::size_t balls;
+    std::unordered_map<std::uint64_t, Cell> cells;
+
+    inline Eigen::Vector3i cellOf(const Eigen::Array3d &p) const
+    {
+        return (p * inv_cell).floor().cast<int>().matrix();
+    }
+
+    //21 bits per (offset) cell coordinate
+    static inline std::uint64_t key(const int i, const int j, const int k)
+    {
+        const std::uint64_t mask = (1 << 21) - 1;
+        return (static_cast<std::uint64_t>(i + (1 << 20)) & mask) |
+               (static_cast<std::uint64_t>(j + (1 << 20)) & mask) << 21 |
+               (static_cast<std::uint64_t>(k + (1 << 20)) & mask) << 42;
+    }
+};
+}
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef GP_EXPLORER_MULTIBRANCH_HPP_
 #define GP_EXPLORER_MULTIBRANCH_HPP_
 
+#include <condition_variable>
 #include <atlas/exp_single_path.hpp>
 
 namespace gp_atlas_rrt
@@ -14,7 +15,7 @@ class ExplorerMultiBranch : public ExplorerSinglePath
 
     ExplorerMultiBranch()=delete;
     ExplorerMultiBranch(const ros::NodeHandle n, const std::string ns):
-        ExplorerSinglePath(n,ns), bias(0.4)
+        ExplorerSinglePath(n,ns), bias(0.4), workers(1), node_limit(0)
     {
     }
     virtual ~ExplorerMultiBranch(){}
@@ -29,20 +30,35 @@ class ExplorerMultiBranch : public ExplorerSinglePath
         if (b>=0.0 && b<=1.0)
             bias = b;
     }
+    /**
+     * \brief number of threads expanding the atlas, 1 is the serial explorer
+     */
+    virtual inline void setWorkers(const std::size_t w)
+    {
+        workers = std::max<std::size_t>(w, 1);
+    }
     /**
      * \brief exploration step, must also callAvailable for ros
      * should also loop on is_running condition.
      */
     virtual void explore()
     {
+        if (workers > 1){
+            exploreParallel();
+            return;
+        }
         if (!atlas){
             ROS_ERROR("[ExplorerMultibranch::%s]\tAtlas not set, set it first",__func__);
             return;
         }
-        std::size_t parent = atlas->createNode(start_point);
-        createNodeMarker(atlas->getNode(parent));
+        std::size_t parent = resumeOrCreateRoot();
+        if (recheckCharted()){
+            std::lock_guard<std::mutex> lock(*mtx_ptr);
+            is_running = false;
+            return;
+        }
         ros::Rate rate(50);
-        while (atlas->countNodes() < max_nodes && !hasSolution())
+        while (atlas->countNodes() < node_limit && !hasSolution())
         {
             if (atlas->isSolution(parent) && atlas->countNodes() != 1)
             {
@@ -69,7 +85,7 @@ class ExplorerMultiBranch : public ExplorerSinglePath
             rate.sleep();
             cb_queue->callAvailable();
         }
-        if (atlas->countNodes() >= max_nodes)
+        if (atlas->countNodes() >= node_limit)
             ROS_WARN("[ExplorerMultibranch::%s]\tMax number of nodes reached, cannot find a solution",__func__);
         if (atlas->num_expandables <= 0)
             ROS_WARN("[ExplorerMultibranch::%s]\tCannot extend the Atlas further, all manifold is charted",__func__);
@@ -90,12 +106,224 @@ class ExplorerMultiBranch : public ExplorerSinglePath
     }
 
 
+    /**
+     * \brief exploration with several workers, each one expanding its own node
+     *
+     * Open nodes are shared in a frontier, a worker takes one out (the last
+     * created or, with probability bias, a random one), samples, collision
+     * checks and projects on it alone, then commits the child through
+     * AtlasCollision::createChild() and puts both nodes back. No node is ever
+     * expanded by two workers at once. This thread only serves ros callbacks.
+     */
+    virtual void exploreParallel()
+    {
+        if (!atlas){
+            ROS_ERROR("[ExplorerMultibranch::%s]\tAtlas not set, set it first",__func__);
+            return;
+        }
+        frontier.clear();
+        busy = 0;
+        finished = false;
+        const std::size_t last = resumeOrCreateRoot();
+        if (recheckCharted()){
+            std::lock_guard<std::mutex> lock(*mtx_ptr);
+            is_running = false;
+            return;
+        }
+        for (std::size_t i=0; i<last; ++i)
+            if (atlas->getNode(i).expandable)
+                frontier.push_back(i);
+        frontier.push_back(last);
+        std::vector<std::thread> pool;
+        for (std::size_t i=0; i<workers; ++i)
+            pool.emplace_back(&ExplorerMultiBranch::expandWorker, this, i);
+        ros::Rate rate(50);
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(frontier_mtx);
+                if (finished)
+                    break;
+            }
+            rate.sleep();
+            cb_queue->callAvailable();
+        }
+        for (auto &t: pool)
+            t.join();
+        if (!solution.empty())
+            highlightSolution(solution);
+        else if (atlas->countNodes() >= node_limit)
+            ROS_WARN("[ExplorerMultibranch::%s]\tMax number of nodes reached, cannot find a solution",__func__);
+        else
+            ROS_WARN("[ExplorerMultibranch::%s]\tCannot extend the Atlas further, all manifold is charted",__func__);
+        std::lock_guard<std::mutex> lock(*mtx_ptr);
+        is_running = false;
+    }
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     protected:
     //atlas pointer
     std::shared_ptr<AtlasCollision> atlas;
     double bias; //probability to chose a random node
                  //to extend instead of last one. (should be in [0,1])
+    std::size_t workers; //threads of exploreParallel()
+    std::size_t node_limit; //stop at this many nodes, max_nodes more than at start
+    //expandable nodes nobody is working on, guarded by frontier_mtx as
+    //branches, solution, busy and finished are
+    std::vector<std::size_t> frontier;
+    std::size_t busy; //nodes taken out of the frontier
+    bool finished;
+    std::mutex frontier_mtx;
+    std::condition_variable frontier_cv;
+
+    /**
+     * \brief The node to expand first: the root of an empty atlas, otherwise
+     * the last node of the atlas, which is kept from previous explorations
+     * (see AtlasVariance::revalidate()) together with its branches.
+     * Also sets node_limit.
+     */
+    std::size_t resumeOrCreateRoot()
+    {
+        std::size_t last;
+        if (atlas->countNodes() == 0){
+            last = atlas->createNode(start_point);
+            root = last;
+            branches.clear();
+            createNodeMarker(atlas->getNode(last));
+        }
+        else{
+            last = atlas->countNodes() - 1;
+            ROS_INFO("[ExplorerMultibranch::%s]\tResuming exploration from %zu charted nodes",__func__, last + 1);
+            followReplacements();
+            clearAtlasMarkers();
+            for (std::size_t i=0; i<=last; ++i)
+            {
+                if (!atlas->getNode(i).isValid())
+                    continue;
+                createNodeMarker(atlas->getNode(i));
+                const auto b = branches.find(i);
+                if (b != branches.end())
+                    createBranchMarker(atlas->getNode(i), atlas->getNode(b->second));
+            }
+        }
+        node_limit = last + max_nodes;
+        return last;
+    }
+
+    /**
+     * \brief Charts replaced by AtlasVariance::revalidate() take the place of
+     * the old ones in the tree: the branches (and the root) are moved to the
+     * last replacement of each node.
+     */
+    void followReplacements()
+    {
+        auto current = [this](std::size_t id)
+        {
+            while (!atlas->getNode(id).isValid())
+                id = atlas->getNode(id).replaced_by;
+            return id;
+        };
+        std::unordered_multimap<std::size_t, std::size_t> moved;
+        for (const auto &b: branches)
+            moved.emplace(current(b.first), current(b.second));
+        branches.swap(moved);
+        root = current(root);
+    }
+
+    /**
+     * \brief When resuming, the variance goal may have changed since the
+     * nodes were charted, so they are checked against it before expanding
+     * anything. The one with the largest variance above the goal becomes the
+     * solution.
+     * \return true if a solution was found
+     */
+    bool recheckCharted()
+    {
+        const std::size_t n = atlas->countNodes();
+        if (n <= 1)
+            return false;
+        std::size_t best = n;
+        double best_v = 0.0;
+        for (std::size_t i=0; i<n; ++i)
+            if (atlas->isSolution(i)){
+                const double v = atlas->getNode(i).getVariance();
+                if (best == n || v > best_v){
+                    best = i;
+                    best_v = v;
+                }
+            }
+        if (best == n)
+            return false;
+        solution = getPathToRoot(best);
+        highlightSolution(solution);
+        ROS_INFO("[ExplorerMultibranch::%s]\tSolution Found among the %zu charted nodes!",__func__, n);
+        return true;
+    }
+
+    /**
+     * \brief body of the index-th exploreParallel() worker
+     */
+    void expandWorker(const std::size_t index)
+    {
+        //one random stream per worker, reproducible under setRandomSeed()
+        setRandomStream(index + 1);
+        while (true)
+        {
+            std::size_t parent;
+            {
+                std::unique_lock<std::mutex> lock(frontier_mtx);
+                frontier_cv.wait(lock, [this](){ return finished || !frontier.empty() || busy == 0; });
+                if (!finished && (frontier.empty() || hasSolution() || atlas->countNodes() >= node_limit))
+                    finished = true;
+                if (finished){
+                    frontier_cv.notify_all();
+                    return;
+                }
+                std::size_t pick = frontier.size() - 1;
+                if (frontier.size() > 1 && getRandIn(0.0, 1.0, true) < bias)
+                    pick = getRandIn(0, static_cast<int>(frontier.size()) - 1);
+                parent = frontier[pick];
+                frontier.erase(frontier.begin() + pick);
+                ++busy;
+            }
+            std::size_t child;
+            bool created = false, expandable = true;
+            try
+            {
+                const Eigen::Vector3d next_point = atlas->getNextState(parent);
+                //zero when no sample could be projected, the parent may still have others
+                expandable = atlas->getNode(parent).expandable;
+                if (!next_point.isZero())
+                    created = atlas->createChild(next_point, parent, child);
+            }
+            catch (const gp_regression::GPRegressionException &e)
+            {
+                ROS_ERROR("[ExplorerMultibranch::%s]\tExpansion of node %zu failed: %s",__func__, parent, e.what());
+                expandable = false;
+            }
+            if (created){
+                createSamplesMarker(atlas->getNode(parent), atlas->getNode(child).getCenter());
+                createNodeMarker(atlas->getNode(child));
+                createBranchMarker(atlas->getNode(child), atlas->getNode(parent));
+            }
+            std::lock_guard<std::mutex> lock(frontier_mtx);
+            --busy;
+            //even if a concurrent child took its sample, the parent has others
+            if (expandable)
+                frontier.push_back(parent);
+            if (created){
+                connect(child, parent);
+                if (atlas->isSolution(child) && solution.empty()){
+                    solution = getPathToRoot(child);
+                    finished = true;
+                    ROS_INFO("[ExplorerMultibranch::%s]\tSolution Found!",__func__);
+                }
+                //the last one is the next to expand, as in the serial explorer
+                frontier.push_back(child);
+            }
+            frontier_cv.notify_all();
+        }
+    }
 };
 }
 
@@ -48,6 +48,7 @@ class ExplorerSinglePath : public ExplorerBase
             return;
         }
         std::size_t parent = atlas->createNode(start_point);
+        root = parent;
         createNodeMarker(atlas->getNode(parent));
         ros::Rate rate(50);
         while (atlas->countNodes() < max_nodes && !hasSolution())
@@ -1,6 +1,7 @@
 #ifndef GP_EXPLORER_HPP_
 #define GP_EXPLORER_HPP_
 
+#include <algorithm>
 #include <memory>
 #include <thread>
 #include <mutex>
@@ -31,7 +32,7 @@ class ExplorerBase
     public:
     ExplorerBase()=delete;
     ExplorerBase(const ros::NodeHandle n, const std::string ns):
-        is_running(false), name(ns)
+        is_running(false), name(ns), root(0)
     {
         father_nh = std::make_shared<ros::NodeHandle>(n);
     }
@@ -178,7 +179,7 @@ class ExplorerBase
 
     virtual void createSamplesMarker(const Chart &c, const Eigen::Vector3d &projected)
     {
-        if (c.samp_chosen < 0 || no_sample_markers)
+        if (c.samp_chosen < 0 || c.samples.rows() == 0 || no_sample_markers)
             return;
         for (size_t i=0; i<c.samples.rows(); ++i)
         {
@@ -240,6 +241,20 @@ class ExplorerBase
         std::lock_guard<std::mutex> guard(*mtx_ptr);
         markers->markers.push_back(proj);
     }
+    /**
+     * \brief remove the node and branch markers, e.g. to create them again
+     */
+    virtual void clearAtlasMarkers()
+    {
+        if (!markers)
+            return;
+        std::lock_guard<std::mutex> guard(*mtx_ptr);
+        auto &m = markers->markers;
+        m.erase(std::remove_if(m.begin(), m.end(), [](const visualization_msgs::Marker &mk)
+                {
+                    return (mk.ns.compare("Atlas Nodes")==0 || mk.ns.compare("Atlas Branches")==0);
+                }), m.end());
+    }
     /**
      * \brief highlight solution path
      */
@@ -276,7 +291,7 @@ class ExplorerBase
         }
     }
     /**
-     * \brief Recurse connections from give child node id to root (root is always 0 id)
+     * \brief Recurse connections from give child node id to root
      * \return ids of traversed nodes, including starting one and root.
      */
     virtual std::vector<std::size_t> getPathToRoot (const std::size_t &id) const
@@ -284,7 +299,7 @@ class ExplorerBase
         std::vector<std::size_t> path;
         path.push_back(id);
         std::size_t parent = id;
-        while (parent != 0)
+        while (parent != root)
         {
             if (branches.count(parent) == 1){
                 auto search = branches.find(parent);
@@ -340,6 +355,8 @@ class ExplorerBase
     std::shared_ptr<std::mutex> mtx_ptr;
     //solution path
     std::vector<std::size_t> solution;
+    //id of the root node, the first one created
+    std::size_t root;
     //enable/disable markers for disc samples
     bool no_sample_markers;
 };
@@ -253,7 +253,7 @@ public:
 
 
     /** Predict variance v[f_*] ~ var(x_*)  */
-    virtual Eigen::Matrix4d var(const Vec3& xStar) {
+    virtual double var(const Vec3& xStar) {
 
         if (sampleset->empty())
             return 0;
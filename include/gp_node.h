@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <mutex>
 #include <thread>
+#include <limits>
 
 // ROS headers
 #include <ros/ros.h>
@@ -59,6 +60,7 @@
 
 // Gaussian Process library
 #include <gp_regression/gp_regressors.h>
+#include <gp_regression/model_buffer.hpp>
 
 //Atlas
 #include <atlas/atlas.hpp>
@@ -75,6 +77,31 @@
 #include <octomap_msgs/conversions.h>
 #include <octomap_ros/conversions.h>
 
+/**\brief Struct ModelViews
+ * {What the node shows of a model, sampled on the thread that built it and
+ * never modified once published}
+*/
+struct ModelViews
+{
+    typedef std::shared_ptr<ModelViews> Ptr;
+    typedef std::shared_ptr<const ModelViews> ConstPtr;
+    //the model they were sampled from
+    gp_regression::Model::ConstPtr model;
+    //sampling grid, one query per slice, and the field evaluated on it
+    //(variance is NaN where it was never needed)
+    std::vector<gp_regression::Data::Ptr> grid_q;
+    std::vector<gp_regression::EvalOutput> grid_out;
+    //grid points on the surface, intensity is variance
+    pcl::PointCloud<pcl::PointXYZI>::Ptr real_explicit;
+    //min max variance found on them
+    double min_v, max_v;
+    //the same points colored by their variance
+    visualization_msgs::Marker samples;
+    //occupancy and mesh of the surface, in the real world
+    std::shared_ptr<octomap::OcTree> octomap;
+    shape_msgs::Mesh predicted_shape;
+};
+
 /**\brief Class GaussianProcessNode
  * {Wraps Gaussian process into a ROS node}
 */
@@ -83,8 +110,8 @@ class GaussianProcessNode
     public:
         /**\brief Constructor */
         GaussianProcessNode ();
-        /**\brief Destructor */
-        virtual ~GaussianProcessNode (){}
+        /**\brief Destructor, waits for the models being built (they publish their views into the node) */
+        virtual ~GaussianProcessNode (){ models.wait(); }
 
         /**\brief Node Handle*/
         ros::NodeHandle nh;
@@ -100,6 +127,11 @@ class GaussianProcessNode
         //automatically call get_next_best_path if synthetic touch is enabled
         void automatedSynthTouch();
 
+        /** \brief Switch to the last model built, if any, along with the views
+         * sampled from it on the builder thread. Only pointers change hands.
+         */
+        void checkModel();
+
         typedef pcl::PointCloud<pcl::PointXYZRGB> PtC;
 
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -142,9 +174,16 @@ class GaussianProcessNode
         //last point touched
         Eigen::Vector3d last_touched;
 
-        // regressor, model and covariance
+        // regressor, model and covariance (evaluate() is const and reentrant, the
+        // sampling threads and the explorer share them without locks)
         gp_regression::ThinPlateRegressor::Ptr reg_;
-        gp_regression::Model::Ptr obj_gp;
+        // snapshot in use, it is never modified: new models are built aside
+        // into models and switched to with checkModel
+        gp_regression::Model::ConstPtr obj_gp;
+        gp_regression::ModelBuffer models;
+        //views of obj_gp, and the last ones built (atomic access, the builder
+        //thread stores them right before publishing their model)
+        ModelViews::ConstPtr views, built_views;
         std::shared_ptr<gp_regression::ThinPlate> my_kernel;
         //gp obj data
         gp_regression::Data::Ptr cloud_gp;
@@ -154,11 +193,47 @@ class GaussianProcessNode
         size_t ext_size;
         //data noise parameter
         double sigma2;
+        //factorize the covariance with the task-parallel blocked LDLT
+        bool blocked_factorization;
+        //compress the covariance (HODLR) instead of forming it, for large training sets
+        bool compressed_covariance;
+        //keep the spectrum of the covariance, to change the noise level without refactorizing
+        bool noise_spectrum;
+        //sort training points and query batches along a Morton curve
+        bool spatial_order;
+        //update the model in place when the touched points fit the current normalization
+        bool incremental_update;
+        //integrate those updates on a background thread, without blocking the node
+        bool background_update;
+        //log the closed form leave-one-out fit of every new model
+        bool loo_diagnostics;
+        //condition the model on the surface normals measured by the touches
+        bool gradient_observations;
+        //noise of those normals
+        double gradient_sigma2;
+        //threads expanding the atlas concurrently
+        int explorer_workers;
+        //disc samples projected together when expanding a chart
+        int speculative_candidates;
+        //draw those samples from a low discrepancy sequence
+        bool quasi_random_sampling;
+        //or search them for the largest variance
+        bool adaptive_sampling;
+        //touched points (processing frame) and their outward unit normals
+        gp_regression::GradientData::Ptr touch_normals;
 
 
         //atlas and explorer
         gp_atlas_rrt::AtlasCollision::Ptr atlas;
         gp_atlas_rrt::ExplorerMultiBranch::Ptr explorer;
+        //points the model gained since the atlas was built on it
+        gp_regression::Data::Ptr atlas_fresh;
+        //the atlas is in an old normalization, it cannot be kept
+        bool atlas_stale;
+        //charts closer than this to those points are refreshed
+        double atlas_influence;
+        //or whose center mean or variance changed more than this
+        double atlas_tol;
         // gp_atlas_rrt::AtlasVariance::Ptr atlas;
         // gp_atlas_rrt::ExplorerSinglePath::Ptr explorer;
         //exploration solution
@@ -202,14 +277,27 @@ class GaussianProcessNode
         bool computeGP();
         // start the RRT exploration
         bool startExploration(const float v_des, Eigen::Vector3d &start);
+        // update a copy of the Gaussian Process with new points, the result
+        // is published in models (and picked up by checkModel)
+        bool updateGP(const gp_regression::Data::ConstPtr &fresh_data);
+        // sample the surface of gp and its products, on the builder thread (nothing is
+        // published), refreshing the grid of previous if gp is an update of its model
+        static ModelViews::Ptr sampleViews(const gp_regression::ThinPlateRegressor::ConstPtr &reg,
+                const gp_regression::Model::ConstPtr &gp, const ModelViews::ConstPtr &previous,
+                const Eigen::Vector3d &offset, const double scale, const std::string &frame_id, const double pass);
+        // the grid plotting
+        static void fakeDeterministicSampling(const gp_regression::ThinPlateRegressor::ConstPtr &reg,
+                ModelViews &views, const double scale=1.0, const double pass=0.08);
+        // the grid plotting, refreshing the grid of previous after an update
+        static void refreshDeterministicSampling(const gp_regression::ThinPlateRegressor::ConstPtr &reg,
+                const ModelViews &previous, ModelViews &views);
+        //add grid points on the surface to the views
+        static void sampleSurface(const gp_regression::ThinPlateRegressor::ConstPtr &reg,
+                const gp_regression::Data::ConstPtr &grid, gp_regression::EvalOutput &field, ModelViews &views);
         // compute octomap from real explicit cloud
-        void computeOctomap();
+        static void computeOctomap(const pcl::PointCloud<pcl::PointXYZI>::Ptr &real_explicit, ModelViews &views);
         // compute the predicted shape from real explicit cloud as a message
-        void computePredictedShapeMsg();
-        // the grid plotting
-        void fakeDeterministicSampling(const bool first_time, const double scale=1.0, const double pass=0.08);
-        //sample at a point
-        void samplePoint(const double x, const double y, const double z, visualization_msgs::Marker &samp);
+        static void computePredictedShapeMsg(const pcl::PointCloud<pcl::PointXYZI> &real_explicit, ModelViews &views);
         // alternative hopefully faster sampling
         void marchingSampling(const bool first_time, const float leaf_size=0.15, const float leaf_pass=0.03);
         // cube sampling for marchingSampling (nested therads)
@@ -0,0 +1,215 @@
+#ifndef GP_REGRESSION___BLOCKED_LDLT_H
+#define GP_REGRESSION___BLOCKED_LDLT_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+#include <gp_regression/thread_pool.hpp>
+
+namespace gp_regression
+{
+
+/**
+ * @brief The BlockedLDLT class Right-looking blocked A = L*D*L^T factorization,
+ * without pivoting, whose panel and trailing updates run as tasks on a ThreadPool.
+ *
+ * Only the lower triangle of A is referenced. When a pivot becomes too small
+ * (the matrix is far from positive definite, e.g. thin plate covariances with
+ * small noise) the factorization stops with info() == Eigen::NumericalIssue,
+ * and it is up to the caller to fall back to a pivoted solver (Eigen::LDLT).
+ */
+class BlockedLDLT
+{
+public:
+        BlockedLDLT() :
+                block_size_(64),
+                pivot_tol_(1e-12),
+                info_(Eigen::InvalidInput)
+        {}
+
+        /**
+         * @brief BlockedLDLT
+         * @param[in] block_size Size of the square tiles the matrix is split into.
+         */
+        explicit BlockedLDLT(const int block_size) :
+                block_size_(std::max(block_size, 1)),
+                pivot_tol_(1e-12),
+                info_(Eigen::InvalidInput)
+        {}
+
+        /**
+         * @brief compute Factorizes A.
+         * @param[in] A Symmetric matrix, only the lower triangle is read.
+         * @param[in] pool Pool the tasks are scheduled on.
+         */
+        BlockedLDLT &compute(const Eigen::MatrixXd &A, ThreadPool &pool = ThreadPool::shared())
+        {
+                if (A.rows() != A.cols() || A.rows() == 0)
+                {
+                        reset();
+                        return *this;
+                }
+                ldl_ = A;
+                d_.resize(A.rows());
+                const double scale = A.diagonal().cwiseAbs().maxCoeff();
+                const double tol = pivot_tol_ * (scale > 0 ? scale : 1.0);
+                const int n = ldl_.rows();
+                info_ = Eigen::Success;
+
+                for (int k = 0; k < n; k += block_size_)
+                {
+                        const int kb = std::min(block_size_, n - k);
+                        const int m = n - k - kb;
+
+                        // diagonal tile, it already carries all the previous updates
+                        if (!factorDiagonal(k, kb, tol))
+                        {
+                                info_ = Eigen::NumericalIssue;
+                                return *this;
+                        }
+                        if (m == 0)
+                                break;
+
+                        // panel, one task per row tile:
+                        // W = A21 * L11^-T and L21 = W * D1^-1
+                        const int tiles = (m + block_size_ - 1) / block_size_;
+                        Eigen::MatrixXd W(m, kb);
+                        pool.parallelFor(tiles, [&](std::size_t t)
+                        {
+                                const int r = t * block_size_;
+                                const int rb = std::min(block_size_, m - r);
+                                Eigen::Block<Eigen::MatrixXd> A21 = ldl_.block(k + kb + r, k, rb, kb);
+                                ldl_.block(k, k, kb, kb).transpose().triangularView<Eigen::UnitUpper>()
+                                        .solveInPlace<Eigen::OnTheRight>(A21);
+                                W.block(r, 0, rb, kb) = A21;
+                                A21 = A21 * d_.segment(k, kb).asDiagonal().inverse();
+                        });
+
+                        // trailing update, one task per lower tile:
+                        // A22 -= L21 * D1 * L21^T = W * L21^T
+                        std::vector<std::pair<int,int>> lower;
+                        for (int j = 0; j < tiles; ++j)
+                                for (int i = j; i < tiles; ++i)
+                                        lower.push_back(std::make_pair(i, j));
+                        pool.parallelFor(lower.size(), [&](std::size_t t)
+                        {
+                                const int r = lower[t].first * block_size_;
+                                const int c = lower[t].second * block_size_;
+                                const int rb = std::min(block_size_, m - r);
+                                const int cb = std::min(block_size_, m - c);
+                                ldl_.block(k + kb + r, k + kb + c, rb, cb).noalias() -=
+                                        W.block(r, 0, rb, kb) * ldl_.block(k + kb + c, k, cb, kb).transpose();
+                        });
+                }
+                return *this;
+        }
+
+        /**
+         * @brief solve Solves A*x = b with the computed factors.
+         */
+        template <typename Rhs>
+        typename Rhs::PlainObject solve(const Eigen::MatrixBase<Rhs> &b) const
+        {
+                typename Rhs::PlainObject x = b;
+                ldl_.triangularView<Eigen::UnitLower>().solveInPlace(x);
+                x = d_.asDiagonal().inverse() * x;
+                ldl_.triangularView<Eigen::UnitLower>().transpose().solveInPlace(x);
+                return x;
+        }
+
+        /**
+         * @brief reset Drops the factors, info() becomes Eigen::InvalidInput.
+         */
+        void reset()
+        {
+                ldl_.resize(0, 0);
+                d_.resize(0);
+                info_ = Eigen::InvalidInput;
+        }
+
+        inline Eigen::ComputationInfo info() const
+        {
+                return info_;
+        }
+
+        inline int rows() const
+        {
+                return ldl_.rows();
+        }
+
+        /**
+         * @brief matrixLDLT Unit lower factor L stored in the lower triangle, the
+         * upper triangle is garbage.
+         */
+        inline const Eigen::MatrixXd &matrixLDLT() const
+        {
+                return ldl_;
+        }
+
+        inline const Eigen::VectorXd &vectorD() const
+        {
+                return d_;
+        }
+
+        inline void setBlockSize(const int bs)
+        {
+                block_size_ = std::max(bs, 1);
+        }
+
+        inline int getBlockSize() const
+        {
+                return block_size_;
+        }
+
+        /**
+         * @brief setPivotTolerance Relative (to the largest diagonal entry)
+         * magnitude below which a pivot is considered zero.
+         */
+        inline void setPivotTolerance(const double tol)
+        {
+                pivot_tol_ = tol;
+        }
+
+private:
+        /**
+         * @brief factorDiagonal Unblocked LDL^T of the kb x kb tile at (k,k).
+         * @return false if a pivot is below tolerance.
+         */
+        bool factorDiagonal(const int k, const int kb, const double tol)
+        {
+                Eigen::Block<Eigen::MatrixXd> A = ldl_.block(k, k, kb, kb);
+                Eigen::VectorBlock<Eigen::VectorXd> d = d_.segment(k, kb);
+                for (int j = 0; j < kb; ++j)
+                {
+                        double dj = A(j,j);
+                        for (int p = 0; p < j; ++p)
+                                dj -= A(j,p) * A(j,p) * d(p);
+                        if (std::abs(dj) <= tol || std::isnan(dj))
+                                return false;
+                        d(j) = dj;
+                        A(j,j) = 1.0;
+                        for (int i = j + 1; i < kb; ++i)
+                        {
+                                double lij = A(i,j);
+                                for (int p = 0; p < j; ++p)
+                                        lij -= A(i,p) * A(j,p) * d(p);
+                                A(i,j) = lij / dj;
+                        }
+                }
+                return true;
+        }
+
+        Eigen::MatrixXd ldl_;
+        Eigen::VectorXd d_;
+        int block_size_;
+        double pivot_tol_;
+        Eigen::ComputationInfo info_;
+};
+
+}
+
+#endif
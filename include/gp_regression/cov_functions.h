@@ -4,5 +4,7 @@
 #include <gp_regression/kernels/gaussian.hpp>
 #include <gp_regression/kernels/laplace.hpp>
 #include <gp_regression/kernels/thin_plate.hpp>
+#include <gp_regression/kernels/composition.hpp>
+#include <gp_regression/kernels/tabulated.hpp>
 
 #endif
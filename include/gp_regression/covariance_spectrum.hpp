@@ -0,0 +1,153 @@
+#ifndef GP_REGRESSION___COVARIANCE_SPECTRUM_H
+#define GP_REGRESSION___COVARIANCE_SPECTRUM_H
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+
+namespace gp_regression
+{
+
+/**
+ * @brief The CovarianceSpectrum class K + s2*I = U*(L + s2*I)*U^T, from the
+ * eigendecomposition K = U*L*U^T of a noise-free covariance.
+ *
+ * The decomposition costs several Cholesky factorizations, but then the
+ * homoscedastic noise s2 can be changed for free: solves are O(n^2) and the
+ * log determinant O(n), so sweeping the noise level does not refactorize.
+ * Conditionally definite kernels (thin plate) have negative eigenvalues: with
+ * some L_i + s2 <= 0 solves still work, but there is no likelihood (NaN), and
+ * when some L_i + s2 vanishes info() becomes Eigen::NumericalIssue.
+ */
+class CovarianceSpectrum
+{
+public:
+        CovarianceSpectrum() :
+                noise_(0.0),
+                info_(Eigen::InvalidInput)
+        {}
+
+        /**
+         * @brief compute Decomposes K, only the lower triangle is read.
+         * @param[in] K Noise-free covariance.
+         * @param[in] s2 Noise level of the following solves.
+         */
+        CovarianceSpectrum &compute(const Eigen::MatrixXd &K, const double s2)
+        {
+                if (K.rows() != K.cols() || K.rows() == 0)
+                {
+                        reset();
+                        return *this;
+                }
+                Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(K);
+                if (eig.info() != Eigen::Success)
+                {
+                        reset();
+                        info_ = eig.info();
+                        return *this;
+                }
+                U_ = eig.eigenvectors();
+                L_ = eig.eigenvalues();
+                setNoise(s2);
+                return *this;
+        }
+
+        /**
+         * @brief setNoise Changes the noise level s2, O(n).
+         */
+        void setNoise(const double s2)
+        {
+                noise_ = s2;
+                if (L_.size() == 0)
+                        return;
+                W_ = (L_.array() + s2).inverse().matrix();
+                const double tol = L_.size()*std::numeric_limits<double>::epsilon()*
+                        std::max(L_.cwiseAbs().maxCoeff(), std::abs(s2));
+                info_ = ((L_.array() + s2).abs() > tol).all() ? Eigen::Success : Eigen::NumericalIssue;
+        }
+
+        /**
+         * @brief solve Solves (K + s2*I)*x = b.
+         */
+        template <typename Rhs>
+        typename Rhs::PlainObject solve(const Eigen::MatrixBase<Rhs> &b) const
+        {
+                typename Rhs::PlainObject x = U_.transpose() * b;
+                x = W_.asDiagonal() * x;
+                return U_ * x;
+        }
+
+        /**
+         * @brief inverseDiagonal diag((K + s2*I)^-1), O(n^2).
+         */
+        Eigen::VectorXd inverseDiagonal() const
+        {
+                return U_.array().square().matrix() * W_;
+        }
+
+        /**
+         * @brief logLikelihood log N(y | 0, K + s2*I) for any s2, given
+         * Uty = U^T*y, O(n). NaN if K + s2*I is not positive definite.
+         */
+        double logLikelihood(const Eigen::VectorXd &Uty, const double s2) const
+        {
+                const Eigen::ArrayXd l = L_.array() + s2;
+                if (!(l > 0.0).all())
+                        return std::numeric_limits<double>::quiet_NaN();
+                return -0.5*(Uty.array().square() / l).sum() - 0.5*l.log().sum()
+                       - 0.5*l.size()*std::log(2*M_PI);
+        }
+
+        /**
+         * @brief reset Drops the decomposition, info() becomes Eigen::InvalidInput.
+         */
+        void reset()
+        {
+                U_.resize(0, 0);
+                L_.resize(0);
+                W_.resize(0);
+                info_ = Eigen::InvalidInput;
+        }
+
+        inline Eigen::ComputationInfo info() const
+        {
+                return info_;
+        }
+
+        inline int rows() const
+        {
+                return L_.size();
+        }
+
+        inline double noise() const
+        {
+                return noise_;
+        }
+
+        inline const Eigen::MatrixXd &eigenvectors() const
+        {
+                return U_;
+        }
+
+        /**
+         * @brief eigenvalues Of the noise-free K, increasing.
+         */
+        inline const Eigen::VectorXd &eigenvalues() const
+        {
+                return L_;
+        }
+
+private:
+        Eigen::MatrixXd U_;
+        Eigen::VectorXd L_;
+        Eigen::VectorXd W_;     // 1/(L + s2)
+        double noise_;
+        Eigen::ComputationInfo info_;
+};
+
+}
+
+#endif
@@ -5,14 +5,24 @@
 #include <functional>
 #include <memory>
 #include <iostream>
+#include <type_traits>
+#include <limits>
+#include <cmath>
 
 #include <Eigen/Core>
 #include <Eigen/LU>
+#include <Eigen/Cholesky>
 #include <Eigen/SVD>
+#include <Eigen/Geometry>
 #include <Eigen/StdVector>
 
 #include <gp_regression/cov_functions.h>
 #include <gp_regression/gp_regression_exception.h>
+#include <gp_regression/blocked_ldlt.hpp>
+#include <gp_regression/hodlr.hpp>
+#include <gp_regression/covariance_spectrum.hpp>
+#include <gp_regression/spatial_order.hpp>
+#include <gp_regression/mean_evaluator.hpp>
 
 namespace gp_regression
 {
@@ -44,17 +54,85 @@ void computeTangentBasis(const Eigen::Vector3d &grad, Eigen::Vector3d &N, Eigen:
 }
 
 /**
- * @brief The Data struct Container for input and query data.
+ * @brief The BasicData struct Container for input and query data with points
+ * of Dim coordinates, stored point after point.
  */
-struct Data
+template <int Dim = Eigen::Dynamic>
+struct BasicData
 {
+        static_assert(Dim > 0, "Points need a positive dimension");
+        typedef Eigen::Matrix<double, Dim, 1> Point;
+        typedef Eigen::Matrix<double, Eigen::Dynamic, Dim> Points;
+
+        std::vector<double> coords;
+        std::vector<double> label;
+        std::vector<double> sigma2;
+        typedef std::shared_ptr<BasicData> Ptr;
+        typedef std::shared_ptr<const BasicData> ConstPtr;
+        void push_back(const Point &p)
+        {
+            coords.insert(coords.end(), p.data(), p.data() + Dim);
+        }
+        void push_back(const Point &p, const double l, const double s2)
+        {
+            push_back(p);
+            label.push_back(l);
+            sigma2.push_back(s2);
+        }
+        std::size_t size() const
+        {
+            return coords.size() / Dim;
+        }
+        bool consistent() const
+        {
+            return coords.size() % Dim == 0;
+        }
+        // one point per row
+        Points points() const
+        {
+            return Eigen::Map<const Eigen::Matrix<double, Dim, Eigen::Dynamic> >(coords.data(), Dim, size()).transpose();
+        }
+        void clear()
+        {
+            coords.clear();
+            label.clear();
+            sigma2.clear();
+        }
+};
+
+/**
+ * @brief The Data struct Container for input and query data, the points have
+ * three coordinates.
+ */
+template <>
+struct BasicData<Eigen::Dynamic>
+{
+        typedef Eigen::MatrixXd Points;
+
         std::vector<double> coord_x;
         std::vector<double> coord_y;
         std::vector<double> coord_z;
         std::vector<double> label;
         std::vector<double> sigma2;
-        typedef std::shared_ptr<Data> Ptr;
-        typedef std::shared_ptr<const Data> ConstPtr;
+        typedef std::shared_ptr<BasicData> Ptr;
+        typedef std::shared_ptr<const BasicData> ConstPtr;
+        std::size_t size() const
+        {
+            return coord_x.size();
+        }
+        bool consistent() const
+        {
+            return coord_y.size() == coord_x.size() && coord_z.size() == coord_x.size();
+        }
+        // one point per row
+        Points points() const
+        {
+            Points P(coord_x.size(), 3);
+            P.col(0) = Eigen::Map<const Eigen::VectorXd>(coord_x.data(), coord_x.size());
+            P.col(1) = Eigen::Map<const Eigen::VectorXd>(coord_y.data(), coord_y.size());
+            P.col(2) = Eigen::Map<const Eigen::VectorXd>(coord_z.data(), coord_z.size());
+            return P;
+        }
         void clear()
         {
             coord_x.clear();
@@ -64,37 +142,333 @@ struct Data
             sigma2.clear();
         }
 };
+typedef BasicData<> Data;
+
+/**
+ * @brief The GradientData struct Container for gradient observations, i.e.
+ * the (un-normalized) normal of the surface measured at some points.
+ */
+struct GradientData
+{
+        std::vector<double> coord_x;
+        std::vector<double> coord_y;
+        std::vector<double> coord_z;
+        std::vector<double> grad_x;
+        std::vector<double> grad_y;
+        std::vector<double> grad_z;
+        std::vector<double> sigma2;     // noise of each component, optional
+        typedef std::shared_ptr<GradientData> Ptr;
+        typedef std::shared_ptr<const GradientData> ConstPtr;
+        void clear()
+        {
+            coord_x.clear();
+            coord_y.clear();
+            coord_z.clear();
+            grad_x.clear();
+            grad_y.clear();
+            grad_z.clear();
+            sigma2.clear();
+        }
+};
+
+/**
+ * @brief The EvalFlags enum Outputs evaluate() can compute, to be OR-ed into a mask.
+ */
+enum EvalFlags : unsigned
+{
+        EVAL_MEAN = 1,          // m(x)
+        EVAL_GRAD = 2,          // m'(x), the un-normalized normal
+        EVAL_VAR = 4,           // v(x)
+        EVAL_TANGENTS = 8,      // tangent basis of m'(x), implies the gradient
+        EVAL_HESSIAN = 16       // m''(x)
+};
+
+/**
+ * @brief The EvalRequest struct Selects which outputs evaluate() computes.
+ */
+struct EvalRequest
+{
+        constexpr EvalRequest(bool m = true, bool g = false, bool v = false, bool t = false, bool h = false) :
+                mean(m), grad(g), var(v), tangents(t), hessian(h) {}
+
+        constexpr unsigned mask() const
+        {
+                return (mean ? EVAL_MEAN : 0u) | (grad ? EVAL_GRAD : 0u) | (var ? EVAL_VAR : 0u) |
+                       (tangents ? EVAL_TANGENTS : 0u) | (hessian ? EVAL_HESSIAN : 0u);
+        }
+
+        bool mean;
+        bool grad;
+        bool var;
+        bool tangents;
+        bool hessian;
+};
+
+/**
+ * @brief The EvalOutput struct Container for the outputs of evaluate(), one
+ * entry (or row) per query point.
+ */
+struct EvalOutput
+{
+        std::vector<double> f;          // mean
+        std::vector<double> v;          // variance
+        Eigen::MatrixXd N;              // gradient (un-normalized normal)
+        Eigen::MatrixXd Tx;             // tangent basis 1
+        Eigen::MatrixXd Ty;             // tangent basis 2
+        std::vector<Eigen::Matrix3d> H; // hessian
+        void clear()
+        {
+            f.clear();
+            v.clear();
+            N.resize(0,0);
+            Tx.resize(0,0);
+            Ty.resize(0,0);
+            H.clear();
+        }
+};
+
+/**
+ * @brief The Factorization enum Which factorization of the covariance a Model uses.
+ */
+enum class Factorization
+{
+        LDLT,           // Eigen::LDLT, single core, diagonal pivoting
+        BLOCKED_LDLT,   // BlockedLDLT on the shared ThreadPool, falls back to LDLT if unstable
+        HODLR,          // HODLRCovariance, Kpp is never formed, falls back to LDLT if unstable
+        EIGEN           // CovarianceSpectrum, the noise level changes in O(n^2), homoscedastic noise only
+};
+
+/**
+ * @brief The UpdateDelta struct Low rank pieces of the last GPRegressor::update(),
+ * relative to the model before it. With k new points, B = Kpp^-1*Kpn,
+ * S = Knn - Knp*B and w = S^-1*(Yn - Knp*alpha).
+ */
+struct UpdateDelta
+{
+        UpdateDelta() : p(0)
+        {
+                // an empty factorization, rather than an uninitialized one
+                S.compute(Eigen::MatrixXd());
+        }
+        int p;                          // training points before the update, 0 if never updated
+        Eigen::MatrixXd B;
+        Eigen::LDLT<Eigen::MatrixXd> S;
+        Eigen::VectorXd w;
+};
 
 /**
- * @brief The Model struct Container for a Gaussian Process model.
+ * @brief The BasicModel struct Container for a Gaussian Process model on
+ * points of Dim coordinates, Model is the one of GPRegressor<CovType>.
  */
-struct Model
+template <int Dim = Eigen::Dynamic>
+struct BasicModel
 {
+        BasicModel() : factorization(Factorization::LDLT), spatial_order(false), cache_distances(false) {}
+
         double R;          // larger pairwise distance in training (includes internal/external)
-        Eigen::MatrixXd P; // points
+        Eigen::Matrix<double, Eigen::Dynamic, Dim> P; // points, one per row
         Eigen::VectorXd Y;  // labels
         Eigen::VectorXd S2;  // noise
         Eigen::MatrixXd N; // (inward) normal at points [not computed by default]
         Eigen::MatrixXd Tx; // tangent basis 1 [not computed by default]
         Eigen::MatrixXd Ty; // tangent basis 2 [not computed by default]
-        Eigen::MatrixXd Kpp; // the covariance matrix
+        Eigen::MatrixXd G; // points with a gradient observation [only with GradientData]
+        Eigen::MatrixXd GY; // observed gradients, one per row of G
+        Eigen::VectorXd GS2; // noise of the gradient components
+        Eigen::MatrixXd Kpp; // the covariance matrix, with gradients the joint one of [Y; GY.row(0)^T; GY.row(1)^T; ...]
         Eigen::LDLT<Eigen::MatrixXd> cholesker; // the robust cholesky-based solver
+        BlockedLDLT blocked_cholesker; // the task-parallel solver [only with Factorization::BLOCKED_LDLT]
+        HODLRCovariance compressed; // the compressed covariance and its solver [only with Factorization::HODLR]
+        CovarianceSpectrum spectrum; // eigendecomposition of the noise-free covariance [only with Factorization::EIGEN]
+        Factorization factorization; // selected solver, preserved by GPRegressor::create
+        bool spatial_order; // keep the training points sorted along a Morton curve, preserved by GPRegressor::create
+        std::vector<int> order; // P.row(i) is the order[i]-th input point [only with spatial_order]
+        bool cache_distances; // keep Dpp for GPRegressor::rekernelize, preserved by GPRegressor::create
+        Eigen::MatrixXd Dpp; // pairwise distances of P [only with cache_distances, not with Factorization::HODLR]
+        UpdateDelta last_update; // what the last update added, used by GPRegressor::refresh
         Eigen::VectorXd alpha; // weights, alpha, this is the only required thing to keep
+        Eigen::MatrixXd beta; // weights of the gradient observations, one row per row of G
+        AlphaMoments moments; // sums of alpha against P [only for kernels with a specialized MeanEvaluator]
         Eigen::MatrixXd Kppdiff; // differential of covariance with selected kernel [not computed by default]
         Eigen::MatrixXd Kppdiffdiff; // twice differential of covariance with selected kernel [not computed by default]
-        typedef std::shared_ptr<Model> Ptr;
-        typedef std::shared_ptr<const Model> ConstPtr;
+        typedef std::shared_ptr<BasicModel> Ptr;
+        typedef std::shared_ptr<const BasicModel> ConstPtr;
 };
+typedef BasicModel<> Model;
+
+/**
+ * @brief factorizeCovariance Factorizes gp.Kpp with the solver selected on the
+ * model and computes alpha = Kpp^-1*targets, for any BasicModel.
+ *
+ * The blocked LDLT does not pivot, if it breaks down or its solution
+ * does not reproduce the targets it is dropped in favour of Eigen::LDLT.
+ * The spectrum needs the same noise on every point (gp.S2), otherwise, or if
+ * the covariance is singular, it is dropped in favour of Eigen::LDLT as well.
+ */
+template <typename ModelType>
+void factorizeCovariance(ModelType &gp, const Eigen::VectorXd &targets)
+{
+        if (gp.factorization == Factorization::EIGEN)
+        {
+                const double s2 = gp.S2.size() > 0 ? gp.S2(0) : 0.0;
+                if (gp.S2.size() == 0 ||
+                    (gp.S2.size() == gp.Kpp.rows() && (gp.S2.array() == s2).all()))
+                {
+                        // the noise is taken out of the decomposed matrix
+                        Eigen::MatrixXd K = gp.Kpp;
+                        K.diagonal().array() -= s2;
+                        gp.spectrum.compute(K, s2);
+                        if (gp.spectrum.info() == Eigen::Success)
+                        {
+                                gp.alpha = gp.spectrum.solve(targets);
+                                return;
+                        }
+                }
+                std::cout << "[factorizeCovariance] The spectrum needs a homoscedastic, non singular covariance, "
+                          << "falling back to pivoted LDLT." << std::endl;
+                gp.spectrum.reset();
+                gp.factorization = Factorization::LDLT;
+        }
+        if (gp.factorization == Factorization::BLOCKED_LDLT)
+        {
+                gp.blocked_cholesker.compute(gp.Kpp);
+                if (gp.blocked_cholesker.info() == Eigen::Success)
+                {
+                        gp.alpha = gp.blocked_cholesker.solve(targets);
+                        const double res = (gp.Kpp*gp.alpha - targets).norm();
+                        if (res <= 1e-8*(1.0 + targets.norm()))
+                                return;
+                }
+                std::cout << "[factorizeCovariance] Blocked LDLT is unstable on this covariance, "
+                          << "falling back to pivoted LDLT." << std::endl;
+                gp.blocked_cholesker.reset();
+        }
+        gp.cholesker.setZero();
+        gp.cholesker.compute(gp.Kpp);
+        gp.alpha = gp.cholesker.solve(targets);
+}
+
+/**
+ * @brief factorizeCovariance Factorizes gp.Kpp and computes alpha = Kpp^-1*Y.
+ */
+template <typename ModelType>
+void factorizeCovariance(ModelType &gp)
+{
+        factorizeCovariance(gp, gp.Y);
+}
+
+/**
+ * @brief solveCovariance Solves Kpp*X = B with whichever factor the model holds.
+ */
+template <typename ModelType, typename Rhs>
+typename Rhs::PlainObject solveCovariance(const ModelType &gp, const Eigen::MatrixBase<Rhs> &B)
+{
+        if (gp.factorization == Factorization::HODLR &&
+            gp.compressed.info() == Eigen::Success)
+                return gp.compressed.solve(B);
+        if (gp.factorization == Factorization::BLOCKED_LDLT &&
+            gp.blocked_cholesker.info() == Eigen::Success)
+                return gp.blocked_cholesker.solve(B);
+        if (gp.factorization == Factorization::EIGEN &&
+            gp.spectrum.info() == Eigen::Success)
+                return gp.spectrum.solve(B);
+        return gp.cholesker.solve(B);
+}
+
+/**
+ * @brief compressCovariance With Factorization::HODLR, compresses and factorizes
+ * the covariance of the points P (one per row) and gp.S2, without forming
+ * gp.Kpp, and computes alpha.
+ * @return false if the compressed factorization broke down, gp is then switched
+ * to Factorization::LDLT and it is up to the caller to form and factorize Kpp.
+ */
+template <typename ModelType, typename CovType>
+bool compressCovariance(ModelType &gp, const Eigen::MatrixXd &P, const CovType &kernel)
+{
+        gp.Kpp.resize(0, 0);
+        gp.compressed.compute(P, gp.S2, kernel);
+        if (gp.compressed.info() == Eigen::Success)
+        {
+                gp.alpha = gp.compressed.solve(gp.Y);
+                return true;
+        }
+        std::cout << "[compressCovariance] Compressed covariance is singular, "
+                  << "falling back to dense LDLT." << std::endl;
+        gp.factorization = Factorization::LDLT;
+        return false;
+}
+
+/**
+ * @brief covarianceInverseDiagonal diag(Kpp^-1) from the factor the model holds.
+ *
+ * With P*Kpp*P^T = L*D*L^T, [Kpp^-1]_ii = sum_k (L^-1)_{k,p(i)}^2 / d_k. It
+ * needs L^-1, i.e. one triangular solve against the identity: O(n^3), half
+ * the cost of the full inverse, but no refactorization. With a compressed
+ * covariance it takes n solves, in blocks of columns, O(n^2 log n). With
+ * the spectrum it is sum_k U_ik^2/(l_k + s2), O(n^2).
+ */
+template <typename ModelType>
+Eigen::VectorXd covarianceInverseDiagonal(const ModelType &gp)
+{
+        if (gp.factorization == Factorization::EIGEN &&
+            gp.spectrum.info() == Eigen::Success)
+                return gp.spectrum.inverseDiagonal();
+        if (gp.factorization == Factorization::HODLR &&
+            gp.compressed.info() == Eigen::Success)
+        {
+                const int n = gp.compressed.rows();
+                const int block = 64;
+                Eigen::VectorXd c(n);
+                for (int j = 0; j < n; j += block)
+                {
+                        const int b = std::min(block, n - j);
+                        Eigen::MatrixXd E = Eigen::MatrixXd::Zero(n, b);
+                        E.middleRows(j, b).setIdentity();
+                        c.segment(j, b) = gp.compressed.solve(E).middleRows(j, b).diagonal();
+                }
+                return c;
+        }
+        const int n = gp.Kpp.rows();
+        Eigen::MatrixXd Linv = Eigen::MatrixXd::Identity(n, n);
+        if (gp.factorization == Factorization::BLOCKED_LDLT &&
+            gp.blocked_cholesker.info() == Eigen::Success)
+        {
+                // no pivoting here
+                gp.blocked_cholesker.matrixLDLT().template triangularView<Eigen::UnitLower>().solveInPlace(Linv);
+                return Linv.array().square().matrix().transpose() * gp.blocked_cholesker.vectorD().cwiseInverse();
+        }
+        gp.cholesker.matrixL().solveInPlace(Linv);
+        const Eigen::VectorXd c = Linv.array().square().matrix().transpose() * gp.cholesker.vectorD().cwiseInverse();
+        return gp.cholesker.transpositionsP().transpose() * c;
+}
 
 /**
  * @brief The GPRegressor class
+ *
+ * GPRegressor<CovType> works on Data and Model, whose points have three
+ * coordinates stored as dynamic matrices. GPRegressor<CovType, Dim> works on
+ * BasicData<Dim> and BasicModel<Dim>, whose points have a dimension known at
+ * compile time, e.g. GPRegressor<ThinPlate, 2> for contours. Gradient
+ * observations, tangents and hessians are only available in three dimensions.
+ *
+ * Thread safety: all the methods are const and the kernel is immutable, so a
+ * regressor can be shared by any number of threads. Every evaluate() (and
+ * refresh()) call works on its own local buffers and only reads the Model,
+ * hence concurrent readers of the same Model need no locking, as long as no
+ * one is writing it: update() modifies the Model in place, so it must not
+ * run while the same Model is being read, and create() always makes a new one.
+ * Hand readers a Model::ConstPtr and treat it as an immutable snapshot.
  */
-template <typename CovType>
+template <typename CovType, int Dim = Eigen::Dynamic>
 class GPRegressor
 {
 public:
-        // pointer to the covariance function type
-        std::shared_ptr<CovType> kernel_;
+        typedef BasicData<Dim> DataType;
+        typedef BasicModel<Dim> ModelType;
+        typedef typename DataType::Points Points;
+
+        // pointer to the covariance function type, immutable once set
+        std::shared_ptr<const CovType> kernel_;
 
         virtual ~GPRegressor() {}
 
@@ -108,77 +482,122 @@ public:
          *        compilation time (assuming a modern and good compiler)
          */
         template <bool withNormals>
-        void create(Data::ConstPtr data, Model::Ptr &gp)
+        void create(typename DataType::ConstPtr data, typename ModelType::Ptr &gp) const
+        {
+                create<withNormals>(data, GradientData::ConstPtr(), gp);
+        }
+
+        /**
+         * @brief create Solves the regression problem given some input data
+         * and gradient observations, e.g. the normals measured by a touch
+         * scaled to the gradient magnitude of the current model.
+         * @param[in] data Input data.
+         * @param[in] gradients Gradient observations, can be empty.
+         * @param[out] gp Gaussian process parameters.
+         *
+         * Values and gradients are jointly gaussian: with c = k'/r, cc = c'/r
+         * and d = x - y, cov(f(x), df(y)/dy_b) = c*(y - x)_b and
+         * cov(df(x)/dx_a, df(y)/dy_b) = -(c*delta_ab + cc*d_a*d_b), hence the
+         * kernel must follow the derivative convention of the regressor
+         * (ThinPlate and its compositions do). The joint covariance is dense,
+         * Factorization::HODLR and Factorization::EIGEN fall back to LDLT,
+         * and the hessian of the mean is not available.
+         */
+        template <bool withNormals>
+        void create(typename DataType::ConstPtr data, GradientData::ConstPtr gradients, typename ModelType::Ptr &gp) const
         {
                 // validate data
                 assertData(data);
 
                 // reset output, we dont care what there was there... yeah, we are badasses
-                gp = std::make_shared<Model>();
+                // (but we keep the solver the user selected on it)
+                const Factorization factorization = gp ? gp->factorization : Factorization::LDLT;
+                const bool spatial_order = gp ? gp->spatial_order : false;
+                const bool cache_distances = gp ? gp->cache_distances : false;
+                gp = std::make_shared<ModelType>();
+                gp->factorization = factorization;
+                gp->spatial_order = spatial_order;
+                gp->cache_distances = cache_distances;
 
                 // configure gp matrices
-                convertToEigen(data->coord_x, data->coord_y, data->coord_z, gp->P);
+                gp->P = data->points();
                 convertToEigen(data->label, gp->Y);
                 convertToEigen(data->sigma2, gp->S2);
-
-                if(withNormals)
+                if (spatial_order)
                 {
-                        gp->N.resize(gp->P.rows(), gp->P.cols());
-                        // gp->Tx.resize(gp->P.rows(), gp->P.cols());
-                        // gp->Ty.resize(gp->P.rows(), gp->P.cols());
+                        // neighbours in space become neighbours in every matrix
+                        gp->order = spatialOrder(gp->P);
+                        permuteRows(gp->order, gp->P);
+                        permuteRows(gp->order, gp->Y);
+                        permuteRows(gp->order, gp->S2);
                 }
+                if (gradients)
+                        appendGradients(gradients, *gp);
 
-                // compute pairwise distance matrix / covariance
-                buildEuclideanDistanceMatrix(gp->P, gp->P, gp->Kpp);
+                fit<withNormals>(*gp);
+        }
 
-                // find larger pairwise distance and normalize pairwise distance matrix
-                gp->R = gp->Kpp.maxCoeff();
+        /**
+         * @brief rekernelize Solves the regression problem again on the same
+         * points and labels, after the kernel (this regressor's, e.g. another
+         * R) or the noise gp->S2 changed. With cached distances
+         * (Model::cache_distances) the O(n^2) distance pass is skipped.
+         * @param[in,out] gp The gaussian process, refresh() no longer applies.
+         */
+        template <bool withNormals>
+        void rekernelize(typename ModelType::Ptr gp) const
+        {
+                if(!gp)
+                        throw GPRegressionException("Empty Model pointer");
+                if (gp->Y.size() == 0 || gp->Y.size() != gp->P.rows())
+                        throw GPRegressionException("Model has no training data");
+                gp->last_update = UpdateDelta();
+                fit<withNormals>(*gp);
+        }
 
-                // copy euclidean matrix
-                if(withNormals)
-                {
-                        gp->Kppdiff.resizeLike(gp->Kpp);
-                        // gp->Kppdiffdiff.resizeLike(Kpp);
-                }
+        /**
+         * @brief evaluate The generic version of evaluate, it computes only
+         * the outputs selected by the request.
+         * @param[in] gp The gaussian process, f(x) ~ gp[m(x), v(x)].
+         * @param[in] query The query values, x.
+         * @param[in] req Which outputs to compute.
+         * @param[out] out The outputs, the ones not requested are left empty.
+         *
+         * \Note: this dispatches at runtime on the request, when the request is
+         *        known at compile time prefer evaluate<Mask>(gp, query, out).
+         */
+        void evaluate(typename ModelType::ConstPtr gp, typename DataType::ConstPtr query, const EvalRequest &req, EvalOutput &out) const
+        {
+                dispatchEvaluate(gp, query, req.mask(), out, std::integral_constant<unsigned, 0>());
+        }
 
-                for(int i = 0; i < gp->Kpp.rows(); ++i)
-                {
-                        for(int j = 0; j < gp->Kpp.cols(); ++j)
-                        {
-                                // do it in this order, so you can make the most of the same matrix
-                                if(withNormals)
-                                {
-                                        // gp->Kppdiffdiff(i,j) = kernel_->computediffdiff(gp->Kpp(i,j));
-                                        gp->Kppdiff(i,j) = kernel_->computediff(gp->Kpp(i,j));
-                                }
-                                if (!(data->sigma2.empty()) && i==j)
-                                        gp->Kpp(i,j) = kernel_->compute(gp->Kpp(i,j)) + data->sigma2.at(i);
-                                else
-                                        gp->Kpp(i,j) = kernel_->compute(gp->Kpp(i,j));
-                        }
-                }
+        /**
+         * @brief evaluate The compile time version of the generic evaluate,
+         * Mask is an OR of EvalFlags, e.g. evaluate<EVAL_MEAN | EVAL_GRAD>(gp, query, out).
+         */
+        template <unsigned Mask>
+        void evaluate(typename ModelType::ConstPtr gp, typename DataType::ConstPtr query, EvalOutput &out) const
+        {
+                if(!gp)
+                        throw GPRegressionException("Empty Model pointer");
 
-                gp->cholesker.setZero();
-                gp->cholesker.compute(gp->Kpp);
-                gp->alpha = gp->cholesker.solve(gp->Y);
+                // validate data
+                assertData(query);
 
-                // normal and tangent computation
-                if(withNormals)
+                if (!query->label.empty())
+                        throw GPRegressionException("Query is already labeled!");
+
+                Points Q = query->points();
+                if (sort_queries_ && Q.rows() > 1)
                 {
-                        for(int i = 0; i < gp->Kpp.rows(); ++i)
-                        {
-                                for(int j = 0; j < gp->Kpp.cols(); ++j)
-                                {
-                                        gp->N.row(i) += gp->alpha(j)*gp->Kppdiff(i,j)*(gp->P.row(i) - gp->P.row(j));
-                                }
-                                gp->N.row(i).normalize();
-                                Eigen::Vector3d N = gp->N.row(i);
-                                // Eigen::Vector3d Tx, Ty;
-                                // computeTangentBasis(N, Tx, Ty);
-                                // gp->Tx.row(i) = Tx;
-                                // gp->Ty.row(i) = Ty;
-                        }
+                        // evaluate along the curve, answer in the caller order
+                        const std::vector<int> order = spatialOrder(Q);
+                        permuteRows(order, Q);
+                        evaluateImpl<Mask>(gp, Q, out);
+                        restoreOrder(order, out);
+                        return;
                 }
+                evaluateImpl<Mask>(gp, Q, out);
         }
 
         /**
@@ -191,24 +610,16 @@ public:
          * @param[out] Tx First basis of the tangent plane at the query value.
          * @param[out] Ty Second basis of the tangent plane at the query value.
          */
-        void evaluate(Model::ConstPtr gp, Data::ConstPtr query, std::vector<double> &f, std::vector<double> &v,
-                      Eigen::MatrixXd &N, Eigen::MatrixXd &Tx, Eigen::MatrixXd &Ty)
+        void evaluate(typename ModelType::ConstPtr gp, typename DataType::ConstPtr query, std::vector<double> &f, std::vector<double> &v,
+                      Eigen::MatrixXd &N, Eigen::MatrixXd &Tx, Eigen::MatrixXd &Ty) const
         {
-                if(!gp)
-                        throw GPRegressionException("Empty Model pointer");
-
-                evaluate(gp, query, f, v, N);
-                Tx.resizeLike(N);
-                Ty.resizeLike(N);
-
-                for(int i = 0; i < N.rows(); ++i)
-                {
-                        Eigen::Vector3d tempTx, tempTy, tempN, tempG;
-                        tempG = N.row(i);
-                        computeTangentBasis(tempG, tempN, tempTx, tempTy);
-                        Tx.row(i) = tempTx;
-                        Ty.row(i) = tempTy;
-                }
+                EvalOutput out;
+                evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD | EVAL_TANGENTS>(gp, query, out);
+                f.swap(out.f);
+                v.swap(out.v);
+                N.swap(out.N);
+                Tx.swap(out.Tx);
+                Ty.swap(out.Ty);
         }
 
         /**
@@ -219,57 +630,13 @@ public:
          * @param[out] v The variance of the function value, v(x).
          * @param[out] N The normal (un-normalized) at the query value, f'(x) = N(f(x))
          */
-        void evaluate(Model::ConstPtr gp, Data::ConstPtr query, std::vector<double> &f, std::vector<double> &v, Eigen::MatrixXd &N)
+        void evaluate(typename ModelType::ConstPtr gp, typename DataType::ConstPtr query, std::vector<double> &f, std::vector<double> &v, Eigen::MatrixXd &N) const
         {
-                if(!gp)
-                        throw GPRegressionException("Empty Model pointer");
-
-                // validate data
-                assertData(query);
-
-                if (!query->label.empty())
-                        throw GPRegressionException("Query is already labeled!");
-
-                // go!
-                Eigen::MatrixXd Q;
-                Eigen::MatrixXd Kqp, Kpq;
-                Eigen::MatrixXd Kqq;
-                Eigen::VectorXd F, V_diagonal;
-                Eigen::MatrixXd V, Vt;
-                convertToEigen(query->coord_x, query->coord_y, query->coord_z, Q);
-                buildEuclideanDistanceMatrix(Q, gp->P, Kqp);
-                N.resizeLike(Q);
-
-                for(int i = 0; i < Kqp.rows(); ++i)
-                {
-                        for(int j = 0; j < Kqp.cols(); ++j)
-                        {
-                                N.row(i) += gp->alpha(j)*kernel_->computediff(Kqp(i,j))*(Q.row(i) - gp->P.row(j));
-                                Kqp(i,j) = kernel_->compute(Kqp(i,j));
-                        }
-                        // N.row(i).normalize(); // to return the gradient properly
-                }
-                F = Kqp*gp->alpha;
-
-                // needed for the variance
-                Kpq = Kqp.transpose();
-                buildEuclideanDistanceMatrix(Q, Q, Kqq);
-
-                for(int i = 0; i < Kqq.array().size(); ++i)
-                        Kqq.array()(i) = kernel_->compute(Kqq.array()(i));
-
-                // V = gp->cholesker.matrixL().solve(Kpq); // this is giving negative and large values
-                                                           // perhaps it is not the correct function
-                V = gp->cholesker.solve(Kpq);
-                // Vt = V.transpose();
-                V = Kqq - Kqp*V;
-                V_diagonal = V.diagonal();
-
-                // conversions
-                convertToSTD(F, f);
-                if (std::isnan(f.at(0))|| std::isinf(f.at(0)))
-                    std::cout<<"Kqp "<<Kqp<<std::endl;
-                convertToSTD(V_diagonal, v);
+                EvalOutput out;
+                evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(gp, query, out);
+                f.swap(out.f);
+                v.swap(out.v);
+                N.swap(out.N);
         }
 
         /**
@@ -279,48 +646,12 @@ public:
          * @param f The function value, m(x).
          * @param v The variance of the function value, v(x).
          */
-        void evaluate(Model::ConstPtr gp, Data::ConstPtr query, std::vector<double> &f, std::vector<double> &v)
+        void evaluate(typename ModelType::ConstPtr gp, typename DataType::ConstPtr query, std::vector<double> &f, std::vector<double> &v) const
         {
-                if(!gp)
-                        throw GPRegressionException("Empty Model pointer");
-
-                // validate data
-                assertData(query);
-
-                if (!query->label.empty())
-                        throw GPRegressionException("Query is already labeled!");
-
-                // go!
-                Eigen::MatrixXd Q;
-                Eigen::MatrixXd Kqp, Kpq;
-                Eigen::MatrixXd Kqq;
-                Eigen::VectorXd F, V_diagonal;
-                Eigen::MatrixXd V, Vt;
-                convertToEigen(query->coord_x, query->coord_y, query->coord_z, Q);
-                buildEuclideanDistanceMatrix(Q, gp->P, Kqp);
-
-                for(int i = 0; i < Kqp.array().size(); ++i)
-                        Kqp.array()(i) = kernel_->compute(Kqp.array()(i));
-
-                F = Kqp*gp->alpha;
-
-                // needed for the variance
-                Kpq = Kqp.transpose();
-                buildEuclideanDistanceMatrix(Q, Q, Kqq);
-
-                for(int i = 0; i < Kqq.array().size(); ++i)
-                        Kqq.array()(i) = kernel_->compute(Kqq.array()(i));
-
-                // V = gp->cholesker.matrixL().solve(Kpq); // this is giving negative and large values
-                                                           // perhaps it is not the correct function
-                V = gp->cholesker.solve(Kpq);
-                // Vt = V.transpose();
-                V = Kqq - Kqp*V;
-                V_diagonal = V.diagonal();
-
-                // conversions
-                convertToSTD(F, f);
-                convertToSTD(V_diagonal, v);
+                EvalOutput out;
+                evaluate<EVAL_MEAN | EVAL_VAR>(gp, query, out);
+                f.swap(out.f);
+                v.swap(out.v);
         }
 
         /**
@@ -329,31 +660,11 @@ public:
          * @param[in] query The query value, x.
          * @param[out] f The function value, m(x).
          */
-        void evaluate(Model::ConstPtr gp, Data::ConstPtr query, std::vector<double> &f)
+        void evaluate(typename ModelType::ConstPtr gp, typename DataType::ConstPtr query, std::vector<double> &f) const
         {
-                if(!gp)
-                        throw GPRegressionException("Empty Model pointer");
-
-                // validate data
-                assertData(query);
-
-                if (!query->label.empty())
-                        throw GPRegressionException("Query is already labeled!");
-
-                // go!
-                Eigen::MatrixXd Q;
-                Eigen::MatrixXd Kqp;
-                Eigen::VectorXd F;
-                convertToEigen(query->coord_x, query->coord_y, query->coord_z, Q);
-                buildEuclideanDistanceMatrix(Q, gp->P, Kqp);
-
-                for(int i = 0; i < Kqp.array().size(); ++i)
-                        Kqp.array()(i) = kernel_->compute(Kqp.array()(i));
-
-                F = Kqp*gp->alpha;
-
-                // conversions
-                convertToSTD(F, f);
+                EvalOutput out;
+                evaluate<EVAL_MEAN>(gp, query, out);
+                f.swap(out.f);
         }
 
         /**
@@ -365,7 +676,7 @@ public:
          *         just keeping it for consistency
          */
         template <bool withNormals>
-        void update(Data::ConstPtr new_data, Model::Ptr gp)
+        void update(typename DataType::ConstPtr new_data, typename ModelType::Ptr gp) const
         {
                 // validate new data
                 assertData(new_data);
@@ -373,16 +684,33 @@ public:
                 if(!gp)
                         throw GPRegressionException("Empty model pointer");
 
+                // no low rank update of the joint covariance
+                if (gp->G.rows() > 0)
+                {
+                        update<withNormals>(new_data, GradientData::ConstPtr(), gp);
+                        return;
+                }
+
                 // configure gp matrices
-                Eigen::MatrixXd new_P;
+                Points new_P = new_data->points();
                 Eigen::VectorXd new_Y, new_S2;
-                convertToEigen(new_data->coord_x, new_data->coord_y, new_data->coord_z, new_P);
                 convertToEigen(new_data->label, new_Y);
                 convertToEigen(new_data->sigma2, new_S2);
 
                 int n = new_data->label.size();
                 int p = gp->Y.rows();
 
+                // the new points are sorted among themselves and appended
+                if (gp->spatial_order)
+                {
+                        const std::vector<int> order = spatialOrder(new_P);
+                        permuteRows(order, new_P);
+                        permuteRows(order, new_Y);
+                        permuteRows(order, new_S2);
+                        for (const int i : order)
+                                gp->order.push_back(p + i);
+                }
+
                 // compute extra values
                 if(withNormals)
                 {
@@ -404,59 +732,60 @@ public:
                         // gp->Kppdiff.resizeLike(gp->Kpp);
                         // gp->Kppdiffdiff.resizeLike(Kpp);
                 }
-
-                for(int i = 0; i < p; ++i)
+                if (gp->cache_distances && gp->Dpp.rows() == p)
                 {
-                        for(int j = 0; j < n; ++j)
-                        {
-                                // do it in this order, so you can make the most of the same matrix
-                                if(withNormals)
-                                {
-                                        // ToDO
-                                        // gp->Kppdiffdiff(i,j) = kernel_->computediffdiff(gp->Kpp(i,j));
-                                        // gp->Kppdiff(i,j) = kernel_->computediff(gp->Kpp(i,j));
-                                }
-                                Kpn(i,j) = kernel_->compute(Kpn(i,j));
-                        }
+                        gp->Dpp.conservativeResize(p + n, p + n);
+                        gp->Dpp.block(p, p, n, n) = Knn;
+                        gp->Dpp.block(0, p, p, n) = Kpn;
+                        gp->Dpp.block(p, 0, n, p) = Kpn.transpose();
+                        gp->R = std::max(gp->R, std::max(Kpn.maxCoeff(), Knn.maxCoeff()));
                 }
-                Knp = Kpn.transpose();
 
-                for(int i = 0; i < n; ++i)
+                Kpn = kernel_->computeArray(Kpn.array()).matrix();
+                Knp = Kpn.transpose();
+                Knn = kernel_->computeArray(Knn.array()).matrix();
+                if (!(new_data->sigma2.empty()))
+                        Knn.diagonal() += new_S2;
+
+                // low rank pieces of the update w.r.t. the current model, they
+                // let refresh() correct fields evaluated on it
+                gp->last_update.p = p;
+                gp->last_update.B = solveCovariance(*gp, Kpn);
+                gp->last_update.S.compute(Knn - Knp*gp->last_update.B);
+                gp->last_update.w = gp->last_update.S.solve(new_Y - Knp*gp->alpha);
+
+                if (gp->factorization != Factorization::HODLR)
                 {
-                        for(int j = 0; j < n; ++j)
-                        {
-                                // do it in this order, so you can make the most of the same matrix
-                                if(withNormals)
-                                {
-                                        // ToDO
-                                        // gp->Kppdiffdiff(i,j) = kernel_->computediffdiff(gp->Kpp(i,j));
-                                        // gp->Kppdiff(i,j) = kernel_->computediff(gp->Kpp(i,j));
-                                }
-                                if (!(new_data->sigma2.empty()) && i==j)
-                                        Knn(i,j) = kernel_->compute(Knn(i,j)) + new_data->sigma2.at(i);
-                                else
-                                        Knn(i,j) = kernel_->compute(Knn(i,j));
-                        }
+                        gp->Kpp.conservativeResize(gp->Kpp.rows() + n, gp->Kpp.cols() + n);
+                        gp->Kpp.block(p, p, n, n) = Knn;
+                        gp->Kpp.block(0, p, p, n) = Kpn;
+                        gp->Kpp.block(p, 0, n, p) = Knp;
                 }
 
-                gp->Kpp.conservativeResize(gp->Kpp.rows() + n, gp->Kpp.cols() + n);
-                gp->Kpp.block(p, p, n, n) = Knn;
-                gp->Kpp.block(0, p, p, n) = Kpn;
-                gp->Kpp.block(p, 0, n, p) = Knp;
-
                 gp->Y.conservativeResize(p + n);
                 gp->Y.block(p, 0, n, 1) = new_Y;
                 gp->S2.conservativeResize(p + n);
                 gp->S2.block(p, 0, n, 1) = new_S2;
-                gp->P.conservativeResize(p + n, 3);
-                gp->P.block(p, 0, n, 3) = new_P;
+                gp->P.conservativeResize(p + n, Eigen::NoChange);
+                gp->P.bottomRows(n) = new_P;
 
                 // ToDO: find new larger pairwise distance
                 // gp->R = gp->Kpp.maxCoeff();
 
-                gp->cholesker.setZero();
-                gp->cholesker.compute(gp->Kpp);
-                gp->alpha = gp->cholesker.solve(gp->Y);
+                // the compressed covariance is rebuilt as a whole, O(n log^2 n)
+                if (!(gp->factorization == Factorization::HODLR &&
+                      compressCovariance(*gp, gp->P, *kernel_)))
+                {
+                        if (gp->Kpp.rows() != gp->P.rows())
+                        {
+                                // the compression broke down, form the whole covariance
+                                buildEuclideanDistanceMatrix(gp->P, gp->P, gp->Kpp);
+                                gp->Kpp = kernel_->computeArray(gp->Kpp.array()).matrix();
+                                gp->Kpp.diagonal() += gp->S2;
+                        }
+                        factorizeCovariance(*gp);
+                }
+                MeanEvaluator<CovType>::precompute(gp->alpha, gp->P, gp->moments);
 
                 // normal and tangent computation
                 if(withNormals)
@@ -478,28 +807,635 @@ public:
                 return;
         }
 
+        /**
+         * @brief update Adds new data and gradient observations to the
+         * gaussian process, either can be empty.
+         *
+         * The joint covariance is solved again as a whole, so refresh()
+         * does not apply to the result.
+         */
+        template <bool withNormals>
+        void update(typename DataType::ConstPtr new_data, GradientData::ConstPtr new_gradients, typename ModelType::Ptr gp) const
+        {
+                if(!gp)
+                        throw GPRegressionException("Empty model pointer");
+
+                if (new_data)
+                {
+                        assertData(new_data);
+                        Points new_P = new_data->points();
+                        Eigen::VectorXd new_Y, new_S2;
+                        convertToEigen(new_data->label, new_Y);
+                        convertToEigen(new_data->sigma2, new_S2);
+                        const int n = new_Y.size();
+                        const int p = gp->Y.size();
+                        if (new_S2.size() != n)
+                                new_S2.setZero(n);
+                        if (gp->spatial_order)
+                        {
+                                const std::vector<int> order = spatialOrder(new_P);
+                                permuteRows(order, new_P);
+                                permuteRows(order, new_Y);
+                                permuteRows(order, new_S2);
+                                for (const int i : order)
+                                        gp->order.push_back(p + i);
+                        }
+                        gp->P.conservativeResize(p + n, Eigen::NoChange);
+                        gp->P.bottomRows(n) = new_P;
+                        gp->Y.conservativeResize(p + n);
+                        gp->Y.tail(n) = new_Y;
+                        gp->S2.conservativeResize(p + n);
+                        gp->S2.tail(n) = new_S2;
+                }
+                if (new_gradients)
+                        appendGradients(new_gradients, *gp);
+
+                gp->last_update = UpdateDelta();
+                fit<withNormals>(*gp);
+        }
+
+        /**
+         * @brief refresh Brings a field evaluated on the model before the last
+         * update() to the updated model, applying the exact low rank correction
+         * of the k new points, in O(q*n*k) instead of evaluating it again.
+         *
+         * With C = Kqn - Kqp*B: m(x) += C*w and v(x) -= diag(C*S^-1*C^T).
+         * @param[in] gp The updated gaussian process.
+         * @param[in] query The points the field was evaluated at.
+         * @param[in,out] out The mean (and optionally the variance) at query.
+         * Variances which are NaN are considered unknown and are left as they are.
+         */
+        void refresh(typename ModelType::ConstPtr gp, typename DataType::ConstPtr query, EvalOutput &out) const
+        {
+                if(!gp)
+                        throw GPRegressionException("Empty Model pointer");
+                if (gp->last_update.p <= 0)
+                        throw GPRegressionException("Model was never updated");
+
+                // validate data
+                assertData(query);
+
+                const UpdateDelta &delta = gp->last_update;
+                const int q = query->size();
+                if (static_cast<int>(out.f.size()) != q || (!out.v.empty() && static_cast<int>(out.v.size()) != q))
+                        throw GPRegressionException("Field does not match the query");
+
+                const Points Q = query->points();
+                Eigen::MatrixXd C, Kqn;
+                buildEuclideanDistanceMatrix(Q, gp->P.topRows(delta.p), C);
+                buildEuclideanDistanceMatrix(Q, gp->P.bottomRows(gp->P.rows() - delta.p), Kqn);
+                C = kernel_->computeArray(C.array()).matrix();
+                Kqn = kernel_->computeArray(Kqn.array()).matrix();
+                C = Kqn - C*delta.B;
+
+                Eigen::Map<Eigen::VectorXd> F(out.f.data(), q);
+                F += C*delta.w;
+                if (!out.v.empty())
+                {
+                        const Eigen::MatrixXd SC = delta.S.solve(C.transpose());
+                        const Eigen::VectorXd dV = (C.array() * SC.transpose().array()).rowwise().sum();
+                        for (int i = 0; i < q; ++i)
+                                if (!std::isnan(out.v[i]))
+                                        out.v[i] -= dV(i);
+                }
+        }
+
+        /**
+         * @brief leaveOneOut Leave-one-out predictions at the training points,
+         * in closed form from the existing factor instead of n refits.
+         *
+         * With c = diag(Kpp^-1): mu_i = y_i - alpha_i/c_i and v_i = 1/c_i, the
+         * predictive variance of the held out label (noise included).
+         * Conditionally definite kernels (thin plate) can give c_i <= 0, such
+         * points get NaN and are left out of the likelihood.
+         * @param[in] gp The gaussian process.
+         * @param[out] mu LOO predictive means, in input order.
+         * @param[out] v LOO predictive variances, in input order.
+         * @return The LOO log predictive likelihood, sum_i log p(y_i | y_-i).
+         */
+        double leaveOneOut(typename ModelType::ConstPtr gp, std::vector<double> &mu, std::vector<double> &v) const
+        {
+                if(!gp)
+                        throw GPRegressionException("Empty Model pointer");
+                if (gp->alpha.size() != gp->Y.size() || gp->Y.size() == 0)
+                        throw GPRegressionException("Model is not trained");
+
+                // with gradient observations only the first n entries are values
+                const Eigen::VectorXd c = covarianceInverseDiagonal(*gp);
+                const int n = gp->Y.size();
+                mu.resize(n);
+                v.resize(n);
+                double log_lik = 0.0;
+                for (int i = 0; i < n; ++i)
+                {
+                        const int j = gp->order.empty() ? i : gp->order[i];
+                        if (!(c(i) > 0))
+                        {
+                                mu[j] = v[j] = std::numeric_limits<double>::quiet_NaN();
+                                continue;
+                        }
+                        mu[j] = gp->Y(i) - gp->alpha(i)/c(i);
+                        v[j] = 1.0/c(i);
+                        // (y_i - mu_i)^2/v_i = alpha_i^2/c_i
+                        log_lik += -0.5*std::log(2*M_PI*v[j]) - 0.5*gp->alpha(i)*gp->alpha(i)/c(i);
+                }
+                return log_lik;
+        }
+
+        /**
+         * @brief setNoise Changes the noise of every training point to sigma2,
+         * from the spectrum of a Factorization::EIGEN model in O(n^2) instead
+         * of a new create(). Normals computed at create() (Model::N) are not
+         * updated and refresh() no longer applies.
+         * @throw GPRegressionException if gp holds no spectrum, or if
+         * sigma2 makes the covariance singular (gp is then left unchanged).
+         */
+        void setNoise(typename ModelType::Ptr gp, const double sigma2) const
+        {
+                if(!gp)
+                        throw GPRegressionException("Empty Model pointer");
+                if (gp->factorization != Factorization::EIGEN ||
+                    gp->spectrum.rows() != gp->Y.size() || gp->Y.size() == 0)
+                        throw GPRegressionException("Model has no covariance spectrum");
+
+                const double old_sigma2 = gp->spectrum.noise();
+                gp->spectrum.setNoise(sigma2);
+                if (gp->spectrum.info() != Eigen::Success)
+                {
+                        gp->spectrum.setNoise(old_sigma2);
+                        throw GPRegressionException("Covariance is singular with this noise");
+                }
+                gp->Kpp.diagonal().array() += sigma2 - old_sigma2;
+                gp->S2.setConstant(gp->Y.size(), sigma2);
+                gp->alpha = gp->spectrum.solve(gp->Y);
+                MeanEvaluator<CovType>::precompute(gp->alpha, gp->P, gp->moments);
+                gp->last_update = UpdateDelta();
+        }
+
+        /**
+         * @brief logLikelihood Log marginal likelihood of the labels, log
+         * N(Y | 0, Kpp + sigma2*I), for several homoscedastic noise levels,
+         * from the spectrum of a Factorization::EIGEN model: O(n^2) once,
+         * then O(n) per level.
+         * @param[in] gp The gaussian process.
+         * @param[in] sigma2 The noise levels.
+         * @param[out] log_lik One per level, NaN where the covariance is not
+         * positive definite (conditionally definite kernels, small noise).
+         */
+        void logLikelihood(typename ModelType::ConstPtr gp, const std::vector<double> &sigma2, std::vector<double> &log_lik) const
+        {
+                if(!gp)
+                        throw GPRegressionException("Empty Model pointer");
+                if (gp->factorization != Factorization::EIGEN ||
+                    gp->spectrum.rows() != gp->Y.size() || gp->Y.size() == 0)
+                        throw GPRegressionException("Model has no covariance spectrum");
+
+                const Eigen::VectorXd Uty = gp->spectrum.eigenvectors().transpose() * gp->Y;
+                log_lik.resize(sigma2.size());
+                for (std::size_t i = 0; i < sigma2.size(); ++i)
+                        log_lik[i] = gp->spectrum.logLikelihood(Uty, sigma2[i]);
+        }
+
         /**
          * @brief setCovFunction
          * @param kernel It requires the same type of kernel the regressor was
          * created with, but it can have different parameters. You need to use this function
          * if you want to change the default parameters the regressor/cov. function
          * are created with.
+         *
+         * \Note: this and setQueryOrdering() are the only non-const methods,
+         *        do not call them while other threads are using the regressor.
          */
-        void setCovFunction(const std::shared_ptr<CovType> &kernel)
+        void setCovFunction(const std::shared_ptr<const CovType> &kernel)
         {
                 kernel_ = kernel;
         }
 
+        /**
+         * @brief setQueryOrdering If set, evaluate() sorts each query batch
+         * along a Morton curve before building its matrices, the outputs
+         * still follow the order of the query.
+         */
+        void setQueryOrdering(const bool sort_queries)
+        {
+                sort_queries_ = sort_queries;
+        }
+
         /**
          * @brief GPRegressor Default constructor, it uses the default constructor of
          * the covariance function.
          */
-        GPRegressor()
+        GPRegressor() :
+                sort_queries_(false)
         {
                 kernel_ = std::make_shared<CovType>();
         }
 
 private:
+        bool sort_queries_;
+
+        /**
+         * @brief permuteRows M.row(i) becomes M.row(order[i]).
+         */
+        template <typename Derived>
+        void permuteRows(const std::vector<int> &order, Eigen::PlainObjectBase<Derived> &M) const
+        {
+                if (M.rows() != static_cast<int>(order.size()))
+                        return;
+                Derived S(M.rows(), M.cols());
+                for (int i = 0; i < S.rows(); ++i)
+                        S.row(i) = M.row(order[i]);
+                M.swap(S);
+        }
+
+        /**
+         * @brief restoreOrder Puts the outputs for the sorted queries back in
+         * the order of the query.
+         */
+        void restoreOrder(const std::vector<int> &order, EvalOutput &out) const
+        {
+                std::vector<double> a;
+                if (!out.f.empty())
+                {
+                        a.resize(out.f.size());
+                        for (std::size_t i = 0; i < order.size(); ++i)
+                                a[order[i]] = out.f[i];
+                        out.f.swap(a);
+                }
+                if (!out.v.empty())
+                {
+                        a.resize(out.v.size());
+                        for (std::size_t i = 0; i < order.size(); ++i)
+                                a[order[i]] = out.v[i];
+                        out.v.swap(a);
+                }
+                Eigen::MatrixXd *M[3] = {&out.N, &out.Tx, &out.Ty};
+                for (Eigen::MatrixXd *m : M)
+                {
+                        if (m->rows() == 0)
+                                continue;
+                        Eigen::MatrixXd S(m->rows(), m->cols());
+                        for (std::size_t i = 0; i < order.size(); ++i)
+                                S.row(order[i]) = m->row(i);
+                        m->swap(S);
+                }
+                if (!out.H.empty())
+                {
+                        std::vector<Eigen::Matrix3d> H(out.H.size());
+                        for (std::size_t i = 0; i < order.size(); ++i)
+                                H[order[i]] = out.H[i];
+                        out.H.swap(H);
+                }
+        }
+
+        /**
+         * @brief fit Covariance, factorization, weights and (withNormals)
+         * normals of the points and labels already on gp.
+         */
+        template <bool withNormals>
+        void fit(ModelType &gp) const
+        {
+                if(withNormals)
+                {
+                        gp.N.setZero(gp.P.rows(), gp.P.cols());
+                        // gp.Tx.resize(gp.P.rows(), gp.P.cols());
+                        // gp.Ty.resize(gp.P.rows(), gp.P.cols());
+                }
+
+                const bool gradients = gp.G.rows() > 0;
+                if (gradients && (gp.factorization == Factorization::HODLR ||
+                                  gp.factorization == Factorization::EIGEN))
+                {
+                        std::cout << "[GPRegressor::fit] Gradient observations need a dense factorization, "
+                                  << "falling back to LDLT." << std::endl;
+                        gp.factorization = Factorization::LDLT;
+                }
+
+                // the compressed covariance is built straight from the points
+                const bool compressed = gp.factorization == Factorization::HODLR &&
+                        compressCovariance(gp, gp.P, *kernel_);
+                if (compressed)
+                {
+                        // no distance matrix, the bounding box diagonal bounds R
+                        gp.R = (gp.P.colwise().maxCoeff() - gp.P.colwise().minCoeff()).norm();
+                }
+                else
+                {
+                        // compute pairwise distance matrix / covariance, either
+                        // in place or kept aside, to change kernel without it
+                        Eigen::MatrixXd &D = gp.cache_distances ? gp.Dpp : gp.Kpp;
+                        if (!gp.cache_distances || gp.Dpp.rows() != gp.P.rows())
+                                buildEuclideanDistanceMatrix(gp.P, gp.P, D);
+
+                        // find larger pairwise distance and normalize pairwise distance matrix
+                        gp.R = D.maxCoeff();
+
+                        // do it in this order, so you can make the most of the same matrix
+                        if(withNormals)
+                        {
+                                // gp.Kppdiffdiff = kernel_->computediffdiffArray(D.array()).matrix();
+                                gp.Kppdiff = kernel_->computediffArray(D.array()).matrix();
+                        }
+                        gp.Kpp = kernel_->computeArray(D.array()).matrix();
+                        if (gp.S2.size() == gp.P.rows())
+                                gp.Kpp.diagonal() += gp.S2;
+
+                        if (gradients)
+                                factorizeJointCovariance(gp);
+                        else
+                                factorizeCovariance(gp);
+                }
+                MeanEvaluator<CovType>::precompute(gp.alpha, gp.P, gp.moments);
+
+                // normal and tangent computation
+                if(withNormals && compressed)
+                {
+                        // one row of Kppdiff at a time
+                        Eigen::MatrixXd D;
+                        for(int i = 0; i < gp.P.rows(); ++i)
+                        {
+                                buildEuclideanDistanceMatrix(gp.P.row(i), gp.P, D);
+                                const Eigen::RowVectorXd w = kernel_->computediffArray(D.array()).matrix()
+                                        * gp.alpha.asDiagonal();
+                                gp.N.row(i) = w.sum()*gp.P.row(i) - w*gp.P;
+                                gp.N.row(i).normalize();
+                        }
+                }
+                else if(withNormals)
+                {
+                        if (gradients)
+                                addGradientTerms(gp, gp.P, nullptr, &gp.N);
+                        for(int i = 0; i < gp.Kppdiff.rows(); ++i)
+                        {
+                                for(int j = 0; j < gp.Kppdiff.cols(); ++j)
+                                {
+                                        gp.N.row(i) += gp.alpha(j)*gp.Kppdiff(i,j)*(gp.P.row(i) - gp.P.row(j));
+                                }
+                                gp.N.row(i).normalize();
+                                // Eigen::Vector3d Tx, Ty;
+                                // computeTangentBasis(gp.N.row(i), Tx, Ty);
+                                // gp.Tx.row(i) = Tx;
+                                // gp.Ty.row(i) = Ty;
+                        }
+                }
+        }
+
+        /**
+         * @brief appendGradients Validates the gradient observations and
+         * appends them to gp.
+         */
+        void appendGradients(GradientData::ConstPtr gradients, ModelType &gp) const
+        {
+                const std::size_t m = gradients->coord_x.size();
+                if (gradients->coord_y.size() != m || gradients->coord_z.size() != m ||
+                    gradients->grad_x.size() != m || gradients->grad_y.size() != m ||
+                    gradients->grad_z.size() != m ||
+                    (!gradients->sigma2.empty() && gradients->sigma2.size() != m))
+                        throw GPRegressionException("Gradient data sizes do not match");
+                if (m == 0)
+                        return;
+                if (gp.P.cols() != 3)
+                        throw GPRegressionException("Gradient observations are only available in three dimensions");
+
+                Eigen::MatrixXd new_G, new_GY;
+                Eigen::VectorXd new_GS2;
+                convertToEigen(gradients->coord_x, gradients->coord_y, gradients->coord_z, new_G);
+                convertToEigen(gradients->grad_x, gradients->grad_y, gradients->grad_z, new_GY);
+                convertToEigen(gradients->sigma2, new_GS2);
+                if (new_GS2.size() != new_G.rows())
+                        new_GS2.setZero(new_G.rows());
+
+                const int g = gp.G.rows();
+                gp.G.conservativeResize(g + m, 3);
+                gp.G.bottomRows(m) = new_G;
+                gp.GY.conservativeResize(g + m, 3);
+                gp.GY.bottomRows(m) = new_GY;
+                gp.GS2.conservativeResize(g + m);
+                gp.GS2.tail(m) = new_GS2;
+        }
+
+        /**
+         * @brief factorizeJointCovariance Extends gp.Kpp (values only, noise
+         * included) with the gradient observations, factorizes it and splits
+         * the weights into alpha and beta.
+         *
+         * The gradient components follow the values, three per row of G, so
+         * the blocks of the first n rows keep their meaning.
+         */
+        void factorizeJointCovariance(ModelType &gp) const
+        {
+                const int n = gp.P.rows();
+                const int m = gp.G.rows();
+                Eigen::MatrixXd Dpg, Dgg;
+                buildEuclideanDistanceMatrix(gp.P, gp.G, Dpg);
+                buildEuclideanDistanceMatrix(gp.G, gp.G, Dgg);
+                gp.R = std::max(gp.R, std::max(Dpg.maxCoeff(), Dgg.maxCoeff()));
+                const Eigen::MatrixXd Cpg = kernel_->computediffArray(Dpg.array()).matrix();
+                const Eigen::MatrixXd Cgg = kernel_->computediffArray(Dgg.array()).matrix();
+                const Eigen::MatrixXd CCgg = kernel_->computediffdiffArray(Dgg.array()).matrix();
+
+                gp.Kpp.conservativeResize(n + 3*m, n + 3*m);
+                for (int j = 0; j < m; ++j)
+                {
+                        // cov(f(p_i), df(g_j)/dg_b) = c*(g_j - p_i)_b
+                        for (int b = 0; b < 3; ++b)
+                                gp.Kpp.col(n + 3*j + b).head(n) =
+                                        (Cpg.col(j).array() * (gp.G(j, b) - gp.P.col(b).array())).matrix();
+                        // cov(df(g_i)/dg_a, df(g_j)/dg_b) = -(c*delta_ab + cc*d_a*d_b)
+                        for (int i = 0; i <= j; ++i)
+                        {
+                                const Eigen::Vector3d d = (gp.G.row(i) - gp.G.row(j)).transpose();
+                                Eigen::Matrix3d B = -CCgg(i, j)*d*d.transpose();
+                                B.diagonal().array() -= Cgg(i, j);
+                                gp.Kpp.template block<3, 3>(n + 3*i, n + 3*j) = B;
+                                gp.Kpp.template block<3, 3>(n + 3*j, n + 3*i) = B.transpose();
+                        }
+                        gp.Kpp.diagonal().template segment<3>(n + 3*j).array() += gp.GS2(j);
+                }
+                gp.Kpp.bottomLeftCorner(3*m, n) = gp.Kpp.topRightCorner(n, 3*m).transpose();
+
+                Eigen::VectorXd targets(n + 3*m);
+                targets.head(n) = gp.Y;
+                for (int j = 0; j < m; ++j)
+                        targets.segment<3>(n + 3*j) = gp.GY.row(j).transpose();
+                factorizeCovariance(gp, targets);
+                gp.beta.resize(m, 3);
+                for (int j = 0; j < m; ++j)
+                        gp.beta.row(j) = gp.alpha.template segment<3>(n + 3*j).transpose();
+                gp.alpha.conservativeResize(n);
+        }
+
+        /**
+         * @brief addGradientTerms Adds the contribution of the gradient
+         * observations to the mean F and to the gradient N at the queries Q.
+         *
+         * With E(i,j) = (q_i - g_j).beta_j: m(q_i) -= sum_j c_ij*E(i,j) and
+         * m'(q_i) -= sum_j [cc_ij*E(i,j)*(q_i - g_j) + c_ij*beta_j].
+         */
+        void addGradientTerms(const ModelType &gp, const Points &Q, Eigen::VectorXd *F, Eigen::MatrixXd *N) const
+        {
+                Eigen::MatrixXd D;
+                buildEuclideanDistanceMatrix(Q, gp.G, D);
+                const Eigen::MatrixXd C = kernel_->computediffArray(D.array()).matrix();
+                Eigen::MatrixXd E = Q * gp.beta.transpose();
+                E.rowwise() -= gp.G.cwiseProduct(gp.beta).rowwise().sum().transpose();
+                if (F)
+                        *F -= C.cwiseProduct(E).rowwise().sum();
+                if (N)
+                {
+                        const Eigen::MatrixXd W = kernel_->computediffdiffArray(D.array()).matrix().cwiseProduct(E);
+                        N->noalias() -= W.rowwise().sum().asDiagonal() * Q;
+                        N->noalias() += W * gp.G;
+                        N->noalias() -= C * gp.beta;
+                }
+        }
+
+        /**
+         * @brief gradientCovariance Kqg(i, 3*j + b) = cov(f(q_i), df(g_j)/dg_b).
+         */
+        Eigen::MatrixXd gradientCovariance(const ModelType &gp, const Points &Q) const
+        {
+                Eigen::MatrixXd D;
+                buildEuclideanDistanceMatrix(Q, gp.G, D);
+                const Eigen::MatrixXd C = kernel_->computediffArray(D.array()).matrix();
+                Eigen::MatrixXd Kqg(Q.rows(), 3*gp.G.rows());
+                for (int j = 0; j < gp.G.rows(); ++j)
+                        for (int b = 0; b < 3; ++b)
+                                Kqg.col(3*j + b) = (C.col(j).array() * (gp.G(j, b) - Q.col(b).array())).matrix();
+                return Kqg;
+        }
+
+        /**
+         * @brief evaluateImpl Computes the outputs in Mask for the queries in Q.
+         *
+         * The distances and the cross covariance Kqp are built once and
+         * shared by all the requested terms, everything not requested is
+         * skipped at compile time.
+         */
+        template <unsigned Mask>
+        void evaluateImpl(typename ModelType::ConstPtr gp, const Points &Q, EvalOutput &out) const
+        {
+                const bool mean = Mask & EVAL_MEAN;
+                const bool var = Mask & EVAL_VAR;
+                const bool tangents = Mask & EVAL_TANGENTS;
+                const bool grad = Mask & (EVAL_GRAD | EVAL_TANGENTS);
+                const bool hessian = Mask & EVAL_HESSIAN;
+
+                const bool gradients = gp->G.rows() > 0;
+                if (hessian && gradients)
+                        throw GPRegressionException("Hessian is not available with gradient observations");
+                if ((tangents || hessian) && Q.cols() != 3)
+                        throw GPRegressionException("Tangents and hessian are only available in three dimensions");
+
+                out.clear();
+                Eigen::MatrixXd D, Kqp;
+                buildEuclideanDistanceMatrix(Q, gp->P, D);
+
+                // the kernel structure gives the mean and gradient more cheaply,
+                // unless Kqp is needed anyway for the variance
+                const bool fast_mean = MeanEvaluator<CovType>::specialized && mean && !var;
+                const bool fast_grad = MeanEvaluator<CovType>::specialized && grad;
+                if (fast_mean || fast_grad)
+                {
+                        Eigen::VectorXd F;
+                        MeanEvaluator<CovType>::evaluate(*kernel_, gp->alpha, gp->P, gp->moments, Q, D,
+                                        fast_mean ? &F : nullptr, fast_grad ? &out.N : nullptr);
+                        if (fast_mean)
+                                convertToSTD(F, out.f);
+                }
+
+                if ((grad && !fast_grad) || hessian)
+                {
+                        // W(i,j) = alpha_j * k'(r_ij)/r_ij, then
+                        // m'(q_i) = sum_j W(i,j)*(q_i - p_j)
+                        const Eigen::MatrixXd W = kernel_->computediffArray(D.array()).matrix() * gp->alpha.asDiagonal();
+                        if (grad && !fast_grad)
+                        {
+                                out.N = W.rowwise().sum().asDiagonal() * Q;
+                                out.N.noalias() -= W * gp->P;
+                        }
+                        if (hessian)
+                        {
+                                // m''(q_i) = sum_j alpha_j*[k'/r*I + (k'/r)'/r*(q_i - p_j)(q_i - p_j)^T]
+                                const Eigen::MatrixXd WW = kernel_->computediffdiffArray(D.array()).matrix() * gp->alpha.asDiagonal();
+                                out.H.assign(Q.rows(), Eigen::Matrix3d::Zero());
+                                for(int i = 0; i < D.rows(); ++i)
+                                {
+                                        const Eigen::MatrixXd d = (-gp->P).rowwise() + Q.row(i);
+                                        out.H[i] = d.transpose() * WW.row(i).asDiagonal() * d;
+                                        out.H[i].diagonal().array() += W.row(i).sum();
+                                }
+                        }
+                }
+
+                if ((mean && !fast_mean) || var)
+                {
+                        Kqp = kernel_->computeArray(D.array()).matrix();
+                }
+
+                if (mean && !fast_mean)
+                {
+                        Eigen::VectorXd F = Kqp*gp->alpha;
+                        convertToSTD(F, out.f);
+                }
+
+                if (gradients && (mean || grad))
+                {
+                        Eigen::VectorXd F = Eigen::VectorXd::Zero(Q.rows());
+                        addGradientTerms(*gp, Q, mean ? &F : nullptr, grad ? &out.N : nullptr);
+                        if (mean)
+                                Eigen::Map<Eigen::VectorXd>(out.f.data(), F.size()) += F;
+                }
+
+                if (var)
+                {
+                        // the gradient observations are part of what is conditioned on
+                        if (gradients)
+                        {
+                                Kqp.conservativeResize(Eigen::NoChange, Kqp.cols() + 3*gp->G.rows());
+                                Kqp.rightCols(3*gp->G.rows()) = gradientCovariance(*gp, Q);
+                        }
+                        // only the diagonal of Kqq - Kqp*Kpp^-1*Kpq is needed
+                        const Eigen::MatrixXd V = solveCovariance(*gp, Kqp.transpose());
+                        Eigen::VectorXd V_diagonal = (Kqp.array() * V.transpose().array()).rowwise().sum();
+                        V_diagonal = kernel_->compute(0.0) - V_diagonal.array();
+                        convertToSTD(V_diagonal, out.v);
+                }
+
+                if (tangents)
+                {
+                        out.Tx.resizeLike(out.N);
+                        out.Ty.resizeLike(out.N);
+                        for(int i = 0; i < out.N.rows(); ++i)
+                        {
+                                Eigen::Vector3d tempTx, tempTy, tempN, tempG;
+                                tempG = out.N.row(i);
+                                computeTangentBasis(tempG, tempN, tempTx, tempTy);
+                                out.Tx.row(i) = tempTx;
+                                out.Ty.row(i) = tempTy;
+                        }
+                }
+        }
+
+        /**
+         * @brief dispatchEvaluate Maps a runtime mask onto its compile time
+         * evaluate<Mask>() instantiation.
+         */
+        template <unsigned Mask>
+        void dispatchEvaluate(typename ModelType::ConstPtr gp, typename DataType::ConstPtr query, const unsigned mask, EvalOutput &out,
+                              std::integral_constant<unsigned, Mask>) const
+        {
+                if (mask == Mask)
+                        evaluate<Mask>(gp, query, out);
+                else
+                        dispatchEvaluate(gp, query, mask, out, std::integral_constant<unsigned, Mask + 1>());
+        }
+
+        void dispatchEvaluate(typename ModelType::ConstPtr, typename DataType::ConstPtr, const unsigned, EvalOutput &,
+                              std::integral_constant<unsigned, 2*EVAL_HESSIAN>) const
+        {
+                throw GPRegressionException("Invalid evaluation request");
+        }
 
         /**
          * @brief convertToEigen
@@ -545,30 +1481,32 @@ private:
          * @param B
          * @param D
          */
-        void buildEuclideanDistanceMatrix(const Eigen::MatrixXd &A,
-            const Eigen::MatrixXd &B,
+        template <typename DerivedA, typename DerivedB>
+        void buildEuclideanDistanceMatrix(const Eigen::MatrixBase<DerivedA> &A,
+            const Eigen::MatrixBase<DerivedB> &B,
             Eigen::MatrixXd &D) const
         {
                 D = -2*A*B.transpose();
                 D.colwise() += A.cwiseProduct(A).rowwise().sum();
                 D.rowwise() += B.cwiseProduct(B).rowwise().sum().transpose();
-                for(int i = 0; i < D.array().size(); ++i)
-                        D.array()(i) = std::sqrt(D.array()(i));
+                // round off can make the squared distance slightly negative
+                D = D.array().max(0.0).sqrt();
         }
 
         /**
          * @brief assertData
          * @param data
          */
-        void assertData(Data::ConstPtr data) const
+        void assertData(typename DataType::ConstPtr data) const
         {
                 if (!data)
                         throw GPRegressionException("Empty data pointer");
-                if (data->coord_x.empty() && data->coord_y.empty()
-                    && data->coord_z.empty() && data->label.empty())
+                if (data->size() == 0 && data->label.empty())
                 {
                         throw GPRegressionException("All input data is empty!");
                 }
+                if (!data->consistent())
+                        throw GPRegressionException("Coordinates do not make whole points");
         }
 
 };
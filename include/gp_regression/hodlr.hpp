@@ -0,0 +1,423 @@
+#ifndef GP_REGRESSION___HODLR_H
+#define GP_REGRESSION___HODLR_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+#include <Eigen/Cholesky>
+
+namespace gp_regression
+{
+
+/**
+ * @brief The HODLRCovariance class Hierarchically off-diagonal low rank
+ * approximation of a covariance K(i,j) = k(|p_i - p_j|) + delta_ij*s2_i,
+ * together with its factorization, built without ever forming K.
+ *
+ * The points are ordered by a cluster tree (recursive median bisection along
+ * the widest extent of the bounding box), so that every node splits into two
+ * spatially coherent halves
+ *
+ *      K = [ K11      U*V^T ]
+ *          [ V*U^T    K22   ]
+ *
+ * whose coupling is compressed by adaptive cross approximation, evaluating
+ * only k*(n1 + n2) kernel entries. Leaves are dense and factored with
+ * Eigen::LDLT, inner nodes are inverted with the Woodbury identity
+ *
+ *      K^-1 = D^-1 - D^-1*W*M^-1*W^T*D^-1,   D = diag(K11, K22), W = diag(U, V),
+ *      M = [ U^T*K11^-1*U   I ; I   V^T*K22^-1*V ],
+ *
+ * so that with off-diagonal ranks bounded by r, building and factoring cost
+ * O(r^2 n log^2 n), solves and products O(r n log n), and storage O(r n log n).
+ *
+ * Solves are exact for the compressed matrix, whose distance from K is
+ * controlled by setTolerance() and setMaxRank(). When a leaf or a capacitance
+ * is singular info() is Eigen::NumericalIssue and the factors are dropped.
+ */
+class HODLRCovariance
+{
+public:
+        HODLRCovariance() :
+                leaf_size_(128),
+                tol_(1e-8),
+                max_rank_(256),
+                info_(Eigen::InvalidInput)
+        {}
+
+        /**
+         * @brief compute Builds and factorizes the compressed covariance.
+         * @param[in] P Points, one per row, any dimension.
+         * @param[in] S2 Noise added to the diagonal, may be empty.
+         * @param[in] kernel Anything with double compute(double r) const.
+         */
+        template <typename CovType>
+        HODLRCovariance &compute(const Eigen::MatrixXd &P, const Eigen::VectorXd &S2, const CovType &kernel)
+        {
+                reset();
+                const int n = P.rows();
+                if (n == 0 || (S2.size() != 0 && S2.size() != n))
+                        return *this;
+
+                perm_.resize(n);
+                std::iota(perm_.begin(), perm_.end(), 0);
+                nodes_.reserve(2 * (n / std::max(leaf_size_ / 2, 1)) + 1);
+                buildTree(P, 0, n);
+
+                // points and noise in tree order
+                points_.resize(n, P.cols());
+                noise_ = Eigen::VectorXd::Zero(n);
+                for (int i = 0; i < n; ++i)
+                {
+                        points_.row(i) = P.row(perm_[i]);
+                        if (S2.size() != 0)
+                                noise_(i) = S2(perm_[i]);
+                }
+
+                info_ = Eigen::Success;
+                factorNode(0, kernel);
+                if (info_ != Eigen::Success)
+                        reset();
+                return *this;
+        }
+
+        /**
+         * @brief solve Solves K*x = b with the compressed factors.
+         */
+        template <typename Rhs>
+        typename Rhs::PlainObject solve(const Eigen::MatrixBase<Rhs> &b) const
+        {
+                Eigen::MatrixXd X(b.rows(), b.cols());
+                for (int i = 0; i < X.rows(); ++i)
+                        X.row(i) = b.row(perm_[i]);
+                solveNode(0, X);
+                typename Rhs::PlainObject x(b.rows(), b.cols());
+                for (int i = 0; i < X.rows(); ++i)
+                        x.row(perm_[i]) = X.row(i);
+                return x;
+        }
+
+        /**
+         * @brief multiply Computes K*x with the compressed matrix, O(r n log n).
+         */
+        template <typename Rhs>
+        typename Rhs::PlainObject multiply(const Eigen::MatrixBase<Rhs> &x) const
+        {
+                Eigen::MatrixXd X(x.rows(), x.cols()), Y(x.rows(), x.cols());
+                for (int i = 0; i < X.rows(); ++i)
+                        X.row(i) = x.row(perm_[i]);
+                multiplyNode(0, X, Y);
+                typename Rhs::PlainObject y(x.rows(), x.cols());
+                for (int i = 0; i < Y.rows(); ++i)
+                        y.row(perm_[i]) = Y.row(i);
+                return y;
+        }
+
+        /**
+         * @brief reset Drops the factors, info() becomes Eigen::InvalidInput.
+         */
+        void reset()
+        {
+                nodes_.clear();
+                perm_.clear();
+                points_.resize(0, 0);
+                noise_.resize(0);
+                info_ = Eigen::InvalidInput;
+        }
+
+        inline Eigen::ComputationInfo info() const
+        {
+                return info_;
+        }
+
+        inline int rows() const
+        {
+                return points_.rows();
+        }
+
+        /**
+         * @brief maxRank Largest rank of the off-diagonal blocks.
+         */
+        int maxRank() const
+        {
+                int r = 0;
+                for (const Node &node : nodes_)
+                        r = std::max(r, static_cast<int>(node.U.cols()));
+                return r;
+        }
+
+        /**
+         * @brief storage Number of doubles held by the factors, against n^2
+         * for the dense covariance.
+         */
+        std::size_t storage() const
+        {
+                std::size_t s = 0;
+                for (const Node &node : nodes_)
+                {
+                        s += node.K.size() + 2 * (node.U.size() + node.V.size());
+                        if (node.U.cols() > 0)
+                                s += node.M.matrixLU().size();
+                }
+                return s;
+        }
+
+        /**
+         * @brief setLeafSize Largest block stored dense.
+         */
+        inline void setLeafSize(const int leaf_size)
+        {
+                leaf_size_ = std::max(leaf_size, 2);
+        }
+
+        inline int getLeafSize() const
+        {
+                return leaf_size_;
+        }
+
+        /**
+         * @brief setTolerance Relative (Frobenius) accuracy of each compressed
+         * off-diagonal block.
+         */
+        inline void setTolerance(const double tol)
+        {
+                tol_ = tol;
+        }
+
+        inline double getTolerance() const
+        {
+                return tol_;
+        }
+
+        /**
+         * @brief setMaxRank Cap on the rank of the off-diagonal blocks.
+         */
+        inline void setMaxRank(const int max_rank)
+        {
+                max_rank_ = std::max(max_rank, 1);
+        }
+
+        inline int getMaxRank() const
+        {
+                return max_rank_;
+        }
+
+private:
+        struct Node
+        {
+                int begin, size;                        // rows in tree order
+                int left, right;                        // children, -1 on leaves
+                Eigen::MatrixXd K;                      // dense block [leaves only]
+                Eigen::LDLT<Eigen::MatrixXd> ldlt;      // its factor [leaves only]
+                Eigen::MatrixXd U, V;                   // K12 = U*V^T
+                Eigen::MatrixXd DiU, DiV;               // K11^-1*U and K22^-1*V
+                Eigen::PartialPivLU<Eigen::MatrixXd> M; // Woodbury capacitance
+        };
+
+        int leaf_size_;
+        double tol_;
+        int max_rank_;
+        Eigen::ComputationInfo info_;
+        std::vector<Node> nodes_;       // nodes_[0] is the root
+        std::vector<int> perm_;         // tree order to input order
+        Eigen::MatrixXd points_;        // in tree order
+        Eigen::VectorXd noise_;         // in tree order
+
+        /**
+         * @brief buildTree Splits perm_[begin, begin + size) at the median of
+         * the widest coordinate, recursively.
+         * @return The index of the node.
+         */
+        int buildTree(const Eigen::MatrixXd &P, const int begin, const int size)
+        {
+                const int id = nodes_.size();
+                nodes_.push_back(Node());
+                nodes_[id].begin = begin;
+                nodes_[id].size = size;
+                nodes_[id].left = nodes_[id].right = -1;
+                if (size <= leaf_size_)
+                        return id;
+
+                Eigen::RowVectorXd lo = P.row(perm_[begin]), hi = lo;
+                for (int i = begin + 1; i < begin + size; ++i)
+                {
+                        lo = lo.cwiseMin(P.row(perm_[i]));
+                        hi = hi.cwiseMax(P.row(perm_[i]));
+                }
+                int dim;
+                (hi - lo).maxCoeff(&dim);
+                const int half = size / 2;
+                std::nth_element(perm_.begin() + begin, perm_.begin() + begin + half, perm_.begin() + begin + size,
+                                 [&P, dim](const int a, const int b) { return P(a, dim) < P(b, dim); });
+
+                const int left = buildTree(P, begin, half);
+                const int right = buildTree(P, begin + half, size - half);
+                nodes_[id].left = left;
+                nodes_[id].right = right;
+                return id;
+        }
+
+        template <typename CovType>
+        inline double entry(const int i, const int j, const CovType &kernel) const
+        {
+                return kernel.compute((points_.row(i) - points_.row(j)).norm());
+        }
+
+        /**
+         * @brief factorNode Children first, then the compressed coupling and
+         * its capacitance.
+         */
+        template <typename CovType>
+        void factorNode(const int id, const CovType &kernel)
+        {
+                Node &node = nodes_[id];
+                if (node.left < 0)
+                {
+                        node.K.resize(node.size, node.size);
+                        for (int j = 0; j < node.size; ++j)
+                                for (int i = 0; i < node.size; ++i)
+                                        node.K(i,j) = entry(node.begin + i, node.begin + j, kernel);
+                        node.K.diagonal() += noise_.segment(node.begin, node.size);
+                        node.ldlt.compute(node.K);
+                        if (node.ldlt.info() != Eigen::Success)
+                                info_ = Eigen::NumericalIssue;
+                        return;
+                }
+                factorNode(node.left, kernel);
+                factorNode(node.right, kernel);
+                if (info_ != Eigen::Success)
+                        return;
+
+                const Node &l = nodes_[node.left];
+                const Node &r = nodes_[node.right];
+                crossApproximation(l.begin, l.size, r.begin, r.size, kernel, node.U, node.V);
+                const int k = node.U.cols();
+                if (k == 0)
+                        return;
+
+                node.DiU = node.U;
+                solveNode(node.left, node.DiU);
+                node.DiV = node.V;
+                solveNode(node.right, node.DiV);
+                Eigen::MatrixXd M = Eigen::MatrixXd::Zero(2 * k, 2 * k);
+                M.topLeftCorner(k, k) = node.U.transpose() * node.DiU;
+                M.bottomRightCorner(k, k) = node.V.transpose() * node.DiV;
+                M.topRightCorner(k, k).setIdentity();
+                M.bottomLeftCorner(k, k).setIdentity();
+                node.M.compute(M);
+                if (!(node.M.rcond() > std::numeric_limits<double>::epsilon()))
+                        info_ = Eigen::NumericalIssue;
+        }
+
+        /**
+         * @brief crossApproximation Adaptive cross approximation with partial
+         * pivoting of the block K(rows, cols) ~ U*V^T, stops when the last
+         * cross is below tol_ times the estimated norm of the block.
+         */
+        template <typename CovType>
+        void crossApproximation(const int row_begin, const int m, const int col_begin, const int n,
+            const CovType &kernel, Eigen::MatrixXd &U, Eigen::MatrixXd &V) const
+        {
+                const int max_rank = std::min(max_rank_, std::min(m, n));
+                U.resize(m, max_rank);
+                V.resize(n, max_rank);
+                std::vector<bool> used(m, false);
+                Eigen::VectorXd row(n), col(m);
+                double norm2 = 0.0;
+                int k = 0, pivot = 0, tried = 0;
+                while (k < max_rank && tried < m)
+                {
+                        used[pivot] = true;
+                        ++tried;
+                        for (int j = 0; j < n; ++j)
+                                row(j) = entry(row_begin + pivot, col_begin + j, kernel);
+                        row.noalias() -= V.leftCols(k) * U.row(pivot).head(k).transpose();
+                        int pj;
+                        const double max_row = row.cwiseAbs().maxCoeff(&pj);
+                        if (max_row > 0)
+                        {
+                                for (int i = 0; i < m; ++i)
+                                        col(i) = entry(row_begin + i, col_begin + pj, kernel);
+                                col.noalias() -= U.leftCols(k) * V.row(pj).head(k).transpose();
+                                U.col(k) = col;
+                                V.col(k) = row / row(pj);
+
+                                // |S_k|^2 = |S_k-1|^2 + 2 sum_l (u_l.u)(v_l.v) + |u|^2 |v|^2
+                                const double uv = U.col(k).squaredNorm() * V.col(k).squaredNorm();
+                                norm2 += uv + 2.0 * (U.leftCols(k).transpose() * U.col(k)).dot(V.leftCols(k).transpose() * V.col(k));
+                                ++k;
+                                if (uv <= tol_ * tol_ * std::abs(norm2))
+                                        break;
+                        }
+                        // next pivot, the largest entry of the last column among the unused rows
+                        double best = -1.0;
+                        for (int i = 0; i < m; ++i)
+                                if (!used[i] && (k == 0 ? 0.0 : std::abs(U(i, k - 1))) > best)
+                                {
+                                        best = k == 0 ? 0.0 : std::abs(U(i, k - 1));
+                                        pivot = i;
+                                }
+                        if (best < 0)
+                                break;
+                }
+                U.conservativeResize(Eigen::NoChange, k);
+                V.conservativeResize(Eigen::NoChange, k);
+        }
+
+        /**
+         * @brief solveNode X = K_node^-1 * X, rows of X in the node's tree order.
+         */
+        void solveNode(const int id, Eigen::Ref<Eigen::MatrixXd> X) const
+        {
+                const Node &node = nodes_[id];
+                if (node.left < 0)
+                {
+                        const Eigen::MatrixXd x = node.ldlt.solve(X);
+                        X = x;
+                        return;
+                }
+                const int m1 = nodes_[node.left].size;
+                const int m2 = nodes_[node.right].size;
+                solveNode(node.left, X.topRows(m1));
+                solveNode(node.right, X.bottomRows(m2));
+                const int k = node.U.cols();
+                if (k == 0)
+                        return;
+                Eigen::MatrixXd t(2 * k, X.cols());
+                t.topRows(k).noalias() = node.U.transpose() * X.topRows(m1);
+                t.bottomRows(k).noalias() = node.V.transpose() * X.bottomRows(m2);
+                const Eigen::MatrixXd s = node.M.solve(t);
+                X.topRows(m1).noalias() -= node.DiU * s.topRows(k);
+                X.bottomRows(m2).noalias() -= node.DiV * s.bottomRows(k);
+        }
+
+        /**
+         * @brief multiplyNode Y = K_node * X, rows in the node's tree order.
+         */
+        void multiplyNode(const int id, const Eigen::Ref<const Eigen::MatrixXd> &X, Eigen::Ref<Eigen::MatrixXd> Y) const
+        {
+                const Node &node = nodes_[id];
+                if (node.left < 0)
+                {
+                        Y.noalias() = node.K * X;
+                        return;
+                }
+                const int m1 = nodes_[node.left].size;
+                const int m2 = nodes_[node.right].size;
+                multiplyNode(node.left, X.topRows(m1), Y.topRows(m1));
+                multiplyNode(node.right, X.bottomRows(m2), Y.bottomRows(m2));
+                if (node.U.cols() == 0)
+                        return;
+                Y.topRows(m1).noalias() += node.U * (node.V.transpose() * X.bottomRows(m2));
+                Y.bottomRows(m2).noalias() += node.V * (node.U.transpose() * X.topRows(m1));
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef GP_REGRESSION___COMPOSITION_H
+#define GP_REGRESSION___COMPOSITION_H
+
+#include <utility>
+
+#include <Eigen/Core>
+
+namespace gp_regression
+{
+
+/*
+ * Compile time composition of kernels, e.g.
+ *
+ *      Sum<ThinPlate, Scaled<Gaussian>>
+ *
+ * is a kernel itself and can be given to GPRegressor. Everything is resolved
+ * at compile time: the scalar methods inline into each other and the array
+ * methods build a single Eigen expression, which the regressor evaluates in
+ * one vectorized loop over the distances, with no temporaries.
+ *
+ * Derivatives follow the convention of the regressor: computediff(r) is
+ * k'(r)/r and computediffdiff(r) is computediff'(r)/r.
+ */
+
+/**
+ * @brief The Sum class k(r) = k1(r) + k2(r).
+ */
+template <typename K1, typename K2>
+class Sum
+{
+public:
+        inline double compute(const double value) const
+        {
+                return k1_.compute(value) + k2_.compute(value);
+        }
+
+        inline double computediff(const double value) const
+        {
+                return k1_.computediff(value) + k2_.computediff(value);
+        }
+
+        inline double computediffdiff(const double value) const
+        {
+                return k1_.computediffdiff(value) + k2_.computediffdiff(value);
+        }
+
+        template <typename Derived>
+        inline auto computeArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<const K1&>().computeArray(value) + std::declval<const K2&>().computeArray(value))
+        {
+                return k1_.computeArray(value) + k2_.computeArray(value);
+        }
+
+        template <typename Derived>
+        inline auto computediffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<const K1&>().computediffArray(value) + std::declval<const K2&>().computediffArray(value))
+        {
+                return k1_.computediffArray(value) + k2_.computediffArray(value);
+        }
+
+        template <typename Derived>
+        inline auto computediffdiffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<const K1&>().computediffdiffArray(value) + std::declval<const K2&>().computediffdiffArray(value))
+        {
+                return k1_.computediffdiffArray(value) + k2_.computediffdiffArray(value);
+        }
+
+        inline const K1 &first() const
+        {
+                return k1_;
+        }
+
+        inline const K2 &second() const
+        {
+                return k2_;
+        }
+
+        Sum(const K1 &k1, const K2 &k2) :
+                k1_(k1),
+                k2_(k2)
+        {}
+
+        Sum() {}
+
+private:
+        K1 k1_;
+        K2 k2_;
+};
+
+/**
+ * @brief The Product class k(r) = k1(r) * k2(r).
+ *
+ * computediff = c1*k2 + k1*c2 and computediffdiff = d1*k2 + 2*c1*c2 + k1*d2,
+ * with c and d the computediff and computediffdiff of the factors.
+ */
+template <typename K1, typename K2>
+class Product
+{
+public:
+        inline double compute(const double value) const
+        {
+                return k1_.compute(value) * k2_.compute(value);
+        }
+
+        inline double computediff(const double value) const
+        {
+                return k1_.computediff(value) * k2_.compute(value) + k1_.compute(value) * k2_.computediff(value);
+        }
+
+        inline double computediffdiff(const double value) const
+        {
+                return k1_.computediffdiff(value) * k2_.compute(value)
+                        + 2 * k1_.computediff(value) * k2_.computediff(value)
+                        + k1_.compute(value) * k2_.computediffdiff(value);
+        }
+
+        template <typename Derived>
+        inline auto computeArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<const K1&>().computeArray(value) * std::declval<const K2&>().computeArray(value))
+        {
+                return k1_.computeArray(value) * k2_.computeArray(value);
+        }
+
+        template <typename Derived>
+        inline auto computediffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<const K1&>().computediffArray(value) * std::declval<const K2&>().computeArray(value)
+                          + std::declval<const K1&>().computeArray(value) * std::declval<const K2&>().computediffArray(value))
+        {
+                return k1_.computediffArray(value) * k2_.computeArray(value)
+                        + k1_.computeArray(value) * k2_.computediffArray(value);
+        }
+
+        template <typename Derived>
+        inline auto computediffdiffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<const K1&>().computediffdiffArray(value) * std::declval<const K2&>().computeArray(value)
+                          + std::declval<double>() * std::declval<const K1&>().computediffArray(value) * std::declval<const K2&>().computediffArray(value)
+                          + std::declval<const K1&>().computeArray(value) * std::declval<const K2&>().computediffdiffArray(value))
+        {
+                return k1_.computediffdiffArray(value) * k2_.computeArray(value)
+                        + 2.0 * k1_.computediffArray(value) * k2_.computediffArray(value)
+                        + k1_.computeArray(value) * k2_.computediffdiffArray(value);
+        }
+
+        inline const K1 &first() const
+        {
+                return k1_;
+        }
+
+        inline const K2 &second() const
+        {
+                return k2_;
+        }
+
+        Product(const K1 &k1, const K2 &k2) :
+                k1_(k1),
+                k2_(k2)
+        {}
+
+        Product() {}
+
+private:
+        K1 k1_;
+        K2 k2_;
+};
+
+/**
+ * @brief The Scaled class k(r) = s * k1(r).
+ */
+template <typename K1>
+class Scaled
+{
+public:
+        inline double compute(const double value) const
+        {
+                return scale_ * k1_.compute(value);
+        }
+
+        inline double computediff(const double value) const
+        {
+                return scale_ * k1_.computediff(value);
+        }
+
+        inline double computediffdiff(const double value) const
+        {
+                return scale_ * k1_.computediffdiff(value);
+        }
+
+        template <typename Derived>
+        inline auto computeArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<double>() * std::declval<const K1&>().computeArray(value))
+        {
+                return scale_ * k1_.computeArray(value);
+        }
+
+        template <typename Derived>
+        inline auto computediffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<double>() * std::declval<const K1&>().computediffArray(value))
+        {
+                return scale_ * k1_.computediffArray(value);
+        }
+
+        template <typename Derived>
+        inline auto computediffdiffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<double>() * std::declval<const K1&>().computediffdiffArray(value))
+        {
+                return scale_ * k1_.computediffdiffArray(value);
+        }
+
+        inline double getScale() const
+        {
+                return scale_;
+        }
+
+        inline const K1 &kernel() const
+        {
+                return k1_;
+        }
+
+        Scaled(double scale, const K1 &k1) :
+                scale_(scale),
+                k1_(k1)
+        {}
+
+        Scaled(double scale) :
+                scale_(scale)
+        {}
+
+        Scaled() :
+                scale_(1.0)
+        {}
+
+private:
+        double scale_;
+        K1 k1_;
+};
+
+}
+
+#endif
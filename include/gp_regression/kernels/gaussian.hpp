@@ -2,6 +2,9 @@
 #define GP_REGRESSION___GAUSSIAN_H
 
 #include <cmath>
+#include <utility>
+
+#include <Eigen/Core>
 
 namespace gp_regression
 {
@@ -12,25 +15,56 @@ public:
         const double sigma_;
         const double length_;
 
-        inline double compute(double &value)
+        inline double compute(const double value) const
         {
                 double power = -1*value*inv_length2_;
                 double out = sigma2_*std::exp(power);
                 return out;
         }
 
-        inline double computediff(double &value)
+        // k'(r)/r, as for every kernel. The kernel has a cusp at r = 0,
+        // where this is taken as zero
+        inline double computediff(const double value) const
+        {
+                if (value <= 0)
+                        return 0.0;
+                double e = compute(value);
+                double out = -1*inv_length2_*e/value;
+                return out;
+        }
+
+        // derivative of computediff over the distance, divided by the distance
+        inline double computediffdiff(const double value) const
         {
+                if (value <= 0)
+                        return 0.0;
                 double e = compute(value);
-                double out = -1*inv_length2_*e;
+                double out = inv_length2_*e*(inv_length2_*value + 1)/(value*value*value);
                 return out;
         }
 
-        inline double computediffdiff(double &value)
+        // the same over an array of distances, as Eigen expressions, so that
+        // composed kernels are evaluated in a single vectorized pass
+        template <typename Derived>
+        inline auto computeArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<double>()*(std::declval<double>()*value).exp())
+        {
+                return sigma2_*(-inv_length2_*value).exp();
+        }
+
+        template <typename Derived>
+        inline auto computediffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype((value > 0.0).select(std::declval<double>()*this->computeArray(value)/value, 0.0))
+        {
+                return (value > 0.0).select(-inv_length2_*computeArray(value)/value, 0.0);
+        }
+
+        template <typename Derived>
+        inline auto computediffdiffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype((value > 0.0).select(std::declval<double>()*this->computeArray(value)
+                                                 *(std::declval<double>()*value + 1.0)/value.cube(), 0.0))
         {
-                // double e = compute(value);
-                // double out = inv_length2_*inv_length2_*e;
-                return 0.0;
+                return (value > 0.0).select(inv_length2_*computeArray(value)*(inv_length2_*value + 1.0)/value.cube(), 0.0);
         }
 
         Gaussian(double sigma, double length) :
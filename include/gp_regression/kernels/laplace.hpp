@@ -24,6 +24,9 @@
 #define GP_REGRESSION___LAPLACE_H
 
 #include <cmath>
+#include <utility>
+
+#include <Eigen/Core>
 
 namespace gp_regression
 {
@@ -34,25 +37,56 @@ public:
         const double sigma_;
         const double length_;
 
-        inline double compute(double &value)
+        inline double compute(const double value) const
         {
                 double power = -1*value*inv_length_;
                 double out = 2*sigma_*std::exp(power);
                 return out;
         }
 
-        inline double computediff(double &value)
+        // k'(r)/r, as for every kernel. The kernel has a cusp at r = 0,
+        // where this is taken as zero
+        inline double computediff(const double value) const
+        {
+                if (value <= 0)
+                        return 0.0;
+                double e = compute(value);
+                double out = -1*inv_length_*e/value;
+                return out;
+        }
+
+        // derivative of computediff over the distance, divided by the distance
+        inline double computediffdiff(const double value) const
         {
+                if (value <= 0)
+                        return 0.0;
                 double e = compute(value);
-                double out = -1*inv_length_*e;
+                double out = inv_length_*e*(inv_length_*value + 1)/(value*value*value);
                 return out;
         }
 
-        inline double computediffdiff(double &value)
+        // the same over an array of distances, as Eigen expressions, so that
+        // composed kernels are evaluated in a single vectorized pass
+        template <typename Derived>
+        inline auto computeArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<double>()*(std::declval<double>()*value).exp())
+        {
+                return 2*sigma_*(-inv_length_*value).exp();
+        }
+
+        template <typename Derived>
+        inline auto computediffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype((value > 0.0).select(std::declval<double>()*this->computeArray(value)/value, 0.0))
+        {
+                return (value > 0.0).select(-inv_length_*computeArray(value)/value, 0.0);
+        }
+
+        template <typename Derived>
+        inline auto computediffdiffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype((value > 0.0).select(std::declval<double>()*this->computeArray(value)
+                                                 *(std::declval<double>()*value + 1.0)/value.cube(), 0.0))
         {
-                // double e = compute(value);
-                // double out = inv_length_*inv_length_*e;
-                return 0.0;
+                return (value > 0.0).select(inv_length_*computeArray(value)*(inv_length_*value + 1.0)/value.cube(), 0.0);
         }
 
         Laplace(double sigma, double length) :
@@ -0,0 +1,268 @@
+#ifndef GP_REGRESSION___TABULATED_H
+#define GP_REGRESSION___TABULATED_H
+
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <utility>
+#include <algorithm>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+#include <gp_regression/gp_regression_exception.h>
+
+namespace gp_regression
+{
+
+/**
+ * @brief The RadialTable class Piecewise cubic interpolant of a function of the
+ * distance on [0, R], over a uniform grid.
+ *
+ * Each interval holds its four coefficients, fitted on the four nearest grid
+ * nodes, so a lookup is one index computation and a Horner step on a single
+ * cache line, branch free inside the range.
+ */
+class RadialTable
+{
+public:
+        /**
+         * @brief RadialTable Tabulates f on [0, R], doubling the intervals
+         * until the interpolation error, checked at seven points per
+         * interval, is below tol*(1 + max|f|).
+         * @throw GPRegressionException if tol is not met with max_intervals.
+         */
+        template <typename Function>
+        RadialTable(const Function &f, const double R, const double tol, const int max_intervals) :
+                R_(R)
+        {
+                if (!(R > 0))
+                        throw GPRegressionException("[RadialTable] Range must be positive");
+                for (int n = 64; ; n *= 2)
+                {
+                        fit(f, n);
+                        error_ = checkError(f);
+                        if (error_ <= tol * (1.0 + scale_))
+                                return;
+                        if (2 * n > max_intervals)
+                        {
+                                std::ostringstream msg;
+                                msg << "[RadialTable] Tolerance not met with " << n << " intervals, max error " << error_;
+                                throw GPRegressionException(msg.str());
+                        }
+                }
+        }
+
+        /**
+         * @brief operator() Interpolated value, only valid on [0, R].
+         */
+        inline double operator()(const double r) const
+        {
+                double t = r * inv_h_;
+                const int k = std::min(static_cast<int>(t), intervals_ - 1);
+                t -= k;
+                const double *c = &coeffs_[4 * k];
+                return c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+        }
+
+        inline double getRange() const
+        {
+                return R_;
+        }
+
+        inline int intervals() const
+        {
+                return intervals_;
+        }
+
+        /**
+         * @brief error Largest interpolation error measured at construction.
+         */
+        inline double error() const
+        {
+                return error_;
+        }
+
+private:
+        double R_;
+        double inv_h_;
+        int intervals_;
+        double scale_;                  // max |f| on the grid
+        double error_;
+        std::vector<double> coeffs_;    // 4 per interval, in the local coordinate t in [0, 1)
+
+        template <typename Function>
+        void fit(const Function &f, const int n)
+        {
+                intervals_ = n;
+                const double h = R_ / n;
+                inv_h_ = 1.0 / h;
+                std::vector<double> y(n + 1);
+                scale_ = 0.0;
+                for (int k = 0; k <= n; ++k)
+                {
+                        y[k] = f(k * h);
+                        scale_ = std::max(scale_, std::abs(y[k]));
+                }
+
+                // cubic through nodes first..first+3, expressed around node k
+                coeffs_.resize(4 * n);
+                for (int k = 0; k < n; ++k)
+                {
+                        const int first = std::min(std::max(k - 1, 0), n - 3);
+                        Eigen::Matrix4d V;
+                        Eigen::Vector4d Y;
+                        for (int i = 0; i < 4; ++i)
+                        {
+                                const double s = first + i - k;
+                                V.row(i) << 1.0, s, s*s, s*s*s;
+                                Y(i) = y[first + i];
+                        }
+                        Eigen::Vector4d::Map(&coeffs_[4 * k]) = V.partialPivLu().solve(Y);
+                }
+        }
+
+        template <typename Function>
+        double checkError(const Function &f) const
+        {
+                const double h = R_ / intervals_;
+                double err = 0.0;
+                for (int k = 0; k < intervals_; ++k)
+                        for (int i = 1; i < 8; ++i)
+                        {
+                                const double t = i / 8.0;
+                                err = std::max(err, std::abs((*this)((k + t) * h) - f((k + t) * h)));
+                        }
+                return err;
+        }
+};
+
+/**
+ * @brief The Tabulated class Any kernel K with compute() and computediff()
+ * read from tables on [0, R] instead of evaluated, e.g.
+ *
+ *      GPRegressor<Tabulated<Gaussian>>
+ *
+ * trades a bounded error (see error()) for not calling std::exp once per
+ * matrix entry. R should be the largest distance met, e.g. Model::R, beyond it
+ * the kernel is evaluated exactly. The derivative is tabulated as
+ * k'(r) = r*computediff(r), which stays bounded where computediff() does not,
+ * e.g. at the cusp of the Gaussian and Laplace kernels; so the error bound
+ * holds on k' and on the gradient terms computediff(r)*(x - y), not on
+ * computediff() itself near r = 0. computediffdiff() is always exact, as it
+ * can be singular at r = 0. Tables are shared among copies.
+ */
+template <typename K>
+class Tabulated
+{
+        // functor of the array methods, declared first to appear in their signatures
+        template <bool Diff>
+        struct Lookup
+        {
+                explicit Lookup(const Tabulated *t) : t_(t) {}
+                inline double operator()(const double r) const
+                {
+                        return Diff ? t_->computediff(r) : t_->compute(r);
+                }
+                const Tabulated *t_;
+        };
+
+public:
+        inline double compute(const double value) const
+        {
+                return value < R_ ? (*k_table_)(value) : kernel_.compute(value);
+        }
+
+        inline double computediff(const double value) const
+        {
+                if (value <= 0)
+                        return kernel_.computediff(value);
+                return value < R_ ? (*d_table_)(value)/value : kernel_.computediff(value);
+        }
+
+        inline double computediffdiff(const double value) const
+        {
+                return kernel_.computediffdiff(value);
+        }
+
+        // element-wise lookups, still Eigen expressions that compose with others
+        template <typename Derived>
+        inline auto computeArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(value.unaryExpr(std::declval<Lookup<false> >()))
+        {
+                return value.unaryExpr(Lookup<false>(this));
+        }
+
+        template <typename Derived>
+        inline auto computediffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(value.unaryExpr(std::declval<Lookup<true> >()))
+        {
+                return value.unaryExpr(Lookup<true>(this));
+        }
+
+        template <typename Derived>
+        inline auto computediffdiffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<const K&>().computediffdiffArray(value))
+        {
+                return kernel_.computediffdiffArray(value);
+        }
+
+        inline const K &kernel() const
+        {
+                return kernel_;
+        }
+
+        inline double getRange() const
+        {
+                return R_;
+        }
+
+        /**
+         * @brief error Largest interpolation error of compute() and of
+         * k'(r) = r*computediff() measured at construction.
+         */
+        inline double error() const
+        {
+                return std::max(k_table_->error(), d_table_->error());
+        }
+
+        /**
+         * @brief Tabulated
+         * @param[in] kernel The kernel to tabulate.
+         * @param[in] R Range of the tables.
+         * @param[in] tol Interpolation error allowed, relative to the largest
+         * value of each table.
+         * @param[in] max_intervals Size limit of each table.
+         * @throw GPRegressionException if tol cannot be met within max_intervals.
+         */
+        Tabulated(const K &kernel, const double R, const double tol = 1e-10, const int max_intervals = 1 << 16) :
+                kernel_(kernel),
+                R_(R)
+        {
+                const K &k = kernel_;
+                k_table_ = std::make_shared<const RadialTable>([&k](double r) { return k.compute(r); }, R, tol, max_intervals);
+                // k' is taken just right of 0, where a cusp makes r*computediff() jump
+                const double r0 = 1e-12*R;
+                d_table_ = std::make_shared<const RadialTable>([&k, r0](double r)
+                                {
+                                        r = std::max(r, r0);
+                                        return r*k.computediff(r);
+                                }, R, tol, max_intervals);
+        }
+
+        Tabulated() :
+                Tabulated(K(), 1.0)
+        {}
+
+private:
+        K kernel_;
+        double R_;
+        std::shared_ptr<const RadialTable> k_table_;
+        std::shared_ptr<const RadialTable> d_table_;
+};
+
+}
+
+#endif
@@ -2,6 +2,9 @@
 #define GP_REGRESSION___THINPLATE_H
 
 #include <cmath>
+#include <utility>
+
+#include <Eigen/Core>
 
 namespace gp_regression
 {
@@ -9,20 +12,48 @@ namespace gp_regression
 class ThinPlate
 {
 public:
-        inline double compute(double value)
+        inline double compute(const double value) const
         {
                 return 2*value*value*value - 3*R_*value*value + R3_;
         }
 
-        inline double computediff(double value)
+        inline double computediff(const double value) const
         {
                 return -6*(R_ - value);
         }
 
-        inline double computediffdiff(double value)
+        // derivative of computediff over the distance, divided by the distance
+        inline double computediffdiff(const double value) const
+        {
+                return value > 0 ? 6/value : 0;
+        }
+
+        // the same over an array of distances, as Eigen expressions, so that
+        // composed kernels are evaluated in a single vectorized pass
+        template <typename Derived>
+        inline auto computeArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype((std::declval<double>()*value - std::declval<double>())*value.square() + std::declval<double>())
+        {
+                return (2.0*value - 3*R_)*value.square() + R3_;
+        }
+
+        template <typename Derived>
+        inline auto computediffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype(std::declval<double>()*value - std::declval<double>())
+        {
+                return 6.0*value - 6*R_;
+        }
+
+        template <typename Derived>
+        inline auto computediffdiffArray(const Eigen::ArrayBase<Derived> &value) const
+                -> decltype((value > 0.0).select(std::declval<double>()*value.inverse(), 0.0))
+        {
+                return (value > 0.0).select(6.0*value.inverse(), 0.0);
+        }
+
+        inline double getR() const
         {
-                // not implemented
-                return 0;
+                return R_;
         }
 
         ThinPlate(double R) :
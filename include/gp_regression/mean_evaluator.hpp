@@ -0,0 +1,97 @@
+#ifndef GP_REGRESSION___MEAN_EVALUATOR_H
+#define GP_REGRESSION___MEAN_EVALUATOR_H
+
+#include <Eigen/Core>
+
+#include <gp_regression/cov_functions.h>
+
+namespace gp_regression
+{
+
+/**
+ * @brief The AlphaMoments struct Sums of the weights against the training
+ * points, precomputed when alpha changes.
+ */
+struct AlphaMoments
+{
+        AlphaMoments() : sum(0.0), P2(0.0) {}
+        double sum;             // sum_j alpha_j
+        Eigen::RowVectorXd P;   // sum_j alpha_j*p_j, as many coordinates as the points
+        double P2;              // sum_j alpha_j*|p_j|^2
+};
+
+/**
+ * @brief The MeanEvaluator struct Computes m(x) and m'(x) exploiting the
+ * structure of the kernel.
+ *
+ * The generic version is not specialized, the regressor then goes through
+ * the kernel matrix Kqp.
+ */
+template <typename CovType>
+struct MeanEvaluator
+{
+        static const bool specialized = false;
+
+        static void precompute(const Eigen::VectorXd &, const Eigen::MatrixXd &, AlphaMoments &) {}
+
+        static void evaluate(const CovType &, const Eigen::VectorXd &, const Eigen::MatrixXd &,
+                             const AlphaMoments &, const Eigen::MatrixXd &, const Eigen::MatrixXd &,
+                             Eigen::VectorXd *, Eigen::MatrixXd *) {}
+};
+
+/**
+ * @brief The MeanEvaluator<ThinPlate> struct Low rank split of the thin plate mean.
+ *
+ * With k(r) = 2r^3 - 3Rr^2 + R^3, summing against alpha gives
+ * m(q) = 2*sum_j alpha_j*r_j^3 - 3R*(|q|^2*sum(alpha) - 2q.sum(alpha*p) + sum(alpha*|p|^2)) + R^3*sum(alpha),
+ * so only the r^3 term needs the per query O(n) sum, the rest are the
+ * AlphaMoments. Likewise m'(q) = 6*sum_j alpha_j*r_j*(q - p_j) - 6R*(q*sum(alpha) - sum(alpha*p)).
+ */
+template <>
+struct MeanEvaluator<ThinPlate>
+{
+        static const bool specialized = true;
+
+        static void precompute(const Eigen::VectorXd &alpha, const Eigen::MatrixXd &P, AlphaMoments &m)
+        {
+                m.sum = alpha.sum();
+                m.P = alpha.transpose() * P;
+                m.P2 = alpha.dot(P.rowwise().squaredNorm());
+        }
+
+        /**
+         * @brief evaluate
+         * @param[in] kernel The thin plate kernel, only R is used.
+         * @param[in] alpha The model weights.
+         * @param[in] P The training points.
+         * @param[in] m The moments of alpha.
+         * @param[in] Q The query points.
+         * @param[in] D Distances between Q and P.
+         * @param[out] F Mean at Q, skipped if null.
+         * @param[out] N Gradient at Q, skipped if null.
+         */
+        static void evaluate(const ThinPlate &kernel, const Eigen::VectorXd &alpha, const Eigen::MatrixXd &P,
+                             const AlphaMoments &m, const Eigen::MatrixXd &Q, const Eigen::MatrixXd &D,
+                             Eigen::VectorXd *F, Eigen::MatrixXd *N)
+        {
+                const double R = kernel.getR();
+                if (F)
+                {
+                        const Eigen::VectorXd Q2 = Q.rowwise().squaredNorm();
+                        *F = 2*(D.array().square() * D.array()).matrix() * alpha;
+                        F->array() -= 3*R*(Q2.array()*m.sum - 2*(Q*m.P.transpose()).array() + m.P2);
+                        F->array() += R*R*R*m.sum;
+                }
+                if (N)
+                {
+                        const Eigen::MatrixXd W = D * alpha.asDiagonal();
+                        *N = (6*W.rowwise().sum().array() - 6*R*m.sum).matrix().asDiagonal() * Q;
+                        N->noalias() -= 6*W*P;
+                        N->rowwise() += 6*R*m.P;
+                }
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef GP_REGRESSION___MODEL_BUFFER_H
+#define GP_REGRESSION___MODEL_BUFFER_H
+
+#include <iostream>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include <gp_regression/gp_regressor.hpp>
+#include <gp_regression/thread_pool.hpp>
+
+namespace gp_regression
+{
+
+/**
+ * @brief The ModelSnapshot struct A published Model together with its version.
+ */
+struct ModelSnapshot
+{
+        ModelSnapshot(const Model::ConstPtr &gp, const std::size_t v) :
+                model(gp), version(v) {}
+        const Model::ConstPtr model;    // never modified once published
+        const std::size_t version;      // incremented at every publish
+        typedef std::shared_ptr<const ModelSnapshot> ConstPtr;
+};
+
+/**
+ * @brief The ModelBuffer class Double buffered Model.
+ *
+ * Readers always get the last published snapshot, while the next Model is
+ * built on a background thread and then published with an atomic swap of the
+ * snapshot pointer. Readers holding the previous snapshot keep using it safely,
+ * it is released with the last of them.
+ *
+ * Builds run one at a time, in submission order, and each of them receives
+ * the model published by the previous one, so they can be chained (e.g.
+ * GPRegressor::update() on a copy of the current model).
+ */
+class ModelBuffer
+{
+public:
+        typedef std::shared_ptr<ModelBuffer> Ptr;
+        // builds the next model from the current one (which may be empty),
+        // returning an empty pointer leaves the current model published
+        typedef std::function<Model::Ptr(Model::ConstPtr)> Builder;
+
+        ModelBuffer() :
+                snapshot_(std::make_shared<ModelSnapshot>(Model::ConstPtr(), 0)),
+                pending_(0),
+                builder_(1)
+        {}
+
+        virtual ~ModelBuffer()
+        {
+                wait();
+        }
+
+        ModelBuffer(const ModelBuffer&) = delete;
+        ModelBuffer &operator=(const ModelBuffer&) = delete;
+
+        /**
+         * @brief snapshot The last published model and its version, safe to
+         * call from any thread.
+         */
+        inline ModelSnapshot::ConstPtr snapshot() const
+        {
+                return std::atomic_load(&snapshot_);
+        }
+
+        inline Model::ConstPtr get() const
+        {
+                return snapshot()->model;
+        }
+
+        inline std::size_t version() const
+        {
+                return snapshot()->version;
+        }
+
+        /**
+         * @brief publish Makes gp the current model.
+         * @return The version of the published model.
+         */
+        std::size_t publish(const Model::ConstPtr &gp)
+        {
+                std::lock_guard<std::mutex> lock(publish_mtx_);
+                ModelSnapshot::ConstPtr next =
+                        std::make_shared<ModelSnapshot>(gp, snapshot()->version + 1);
+                std::atomic_store(&snapshot_, next);
+                return next->version;
+        }
+
+        /**
+         * @brief rebuild Schedules build on the background thread and returns
+         * immediately, its result is published when done.
+         *
+         * If build throws, the error is reported and the current model is kept.
+         */
+        void rebuild(const Builder &build)
+        {
+                {
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        ++pending_;
+                }
+                builder_.submit([this, build]()
+                {
+                        try
+                        {
+                                Model::Ptr next = build(get());
+                                if (next)
+                                        publish(next);
+                        }
+                        catch (const std::exception &e)
+                        {
+                                std::cout << "[ModelBuffer::rebuild] " << e.what()
+                                          << ", keeping the current model." << std::endl;
+                        }
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        if (--pending_ == 0)
+                                cv_.notify_all();
+                });
+        }
+
+        /**
+         * @brief isBuilding True while some rebuild() is queued or running.
+         */
+        bool isBuilding() const
+        {
+                std::lock_guard<std::mutex> lock(mtx_);
+                return pending_ > 0;
+        }
+
+        /**
+         * @brief wait Blocks until all the scheduled rebuilds are published.
+         */
+        void wait()
+        {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, [this](){ return pending_ == 0; });
+        }
+
+        /**
+         * @brief reset Waits for the scheduled rebuilds and publishes an empty
+         * model, the version keeps counting.
+         */
+        void reset()
+        {
+                wait();
+                publish(Model::ConstPtr());
+        }
+
+private:
+        ModelSnapshot::ConstPtr snapshot_;
+        std::mutex publish_mtx_;
+        mutable std::mutex mtx_;
+        std::condition_variable cv_;
+        std::size_t pending_;
+        // declared last, so that its worker is joined first
+        ThreadPool builder_;
+};
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef GP_REGRESSION___SPATIAL_ORDER_H
+#define GP_REGRESSION___SPATIAL_ORDER_H
+
+#include <vector>
+#include <cstdint>
+#include <numeric>
+#include <algorithm>
+
+#include <Eigen/Core>
+
+namespace gp_regression
+{
+
+/**
+ * @brief mortonCode Interleaves the lower 21 bits of x, y and z, i.e. the
+ * position of the cell (x, y, z) along a Z-order curve.
+ */
+inline std::uint64_t mortonCode(const std::uint32_t x, const std::uint32_t y, const std::uint32_t z)
+{
+        // spreads 21 bits apart by two zeros
+        struct Split
+        {
+                static std::uint64_t bits(const std::uint32_t a)
+                {
+                        std::uint64_t v = a & 0x1fffff;
+                        v = (v | v << 32) & 0x1f00000000ffffULL;
+                        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+                        v = (v | v << 8) & 0x100f00f00f00f00fULL;
+                        v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+                        v = (v | v << 2) & 0x1249249249249249ULL;
+                        return v;
+                }
+        };
+        return Split::bits(x) | Split::bits(y) << 1 | Split::bits(z) << 2;
+}
+
+/**
+ * @brief spatialOrder Permutation sorting the points (rows of P, the first
+ * three coordinates are used) along a Morton curve over their bounding box.
+ *
+ * Points close along the curve are close in space, so consecutive rows of
+ * anything indexed by the sorted points (distances, covariances) touch
+ * nearby data.
+ * @return order, such that P.row(order[i]) is the i-th point along the curve.
+ */
+inline std::vector<int> spatialOrder(const Eigen::MatrixXd &P)
+{
+        const int n = P.rows();
+        const int dims = std::min<int>(P.cols(), 3);
+        std::vector<int> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        if (n < 2 || dims == 0)
+                return order;
+
+        const Eigen::RowVectorXd lo = P.leftCols(dims).colwise().minCoeff();
+        const Eigen::RowVectorXd extent = P.leftCols(dims).colwise().maxCoeff() - lo;
+        const double cells = (1 << 21) - 1;
+        std::vector<std::uint64_t> codes(n);
+        for (int i = 0; i < n; ++i)
+        {
+                std::uint32_t c[3] = {0, 0, 0};
+                for (int d = 0; d < dims; ++d)
+                        if (extent(d) > 0)
+                                c[d] = static_cast<std::uint32_t>((P(i, d) - lo(d)) / extent(d) * cells);
+                codes[i] = mortonCode(c[0], c[1], c[2]);
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [&codes](const int a, const int b) { return codes[a] < codes[b]; });
+        return order;
+}
+
+}
+
+#endif
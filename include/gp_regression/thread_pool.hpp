@@ -0,0 +1,184 @@
+#ifndef GP_REGRESSION___THREAD_POOL_H
+#define GP_REGRESSION___THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <algorithm>
+
+namespace gp_regression
+{
+
+/**
+ * @brief The ThreadPool class A fixed set of worker threads consuming a FIFO
+ * task queue.
+ *
+ * Heavy linear algebra (e.g. the blocked factorization of the covariance) is
+ * split into tasks and scheduled here, so that every model shares the same
+ * workers instead of spawning its own threads.
+ */
+class ThreadPool
+{
+public:
+        typedef std::shared_ptr<ThreadPool> Ptr;
+
+        /**
+         * @brief ThreadPool Spawns the workers.
+         * @param[in] workers Number of worker threads, it can be zero, in which
+         * case every parallelFor() runs serially on the calling thread.
+         */
+        explicit ThreadPool(const std::size_t workers) :
+                stop_(false)
+        {
+                for (std::size_t i = 0; i < workers; ++i)
+                        workers_.emplace_back(&ThreadPool::work, this);
+        }
+
+        virtual ~ThreadPool()
+        {
+                {
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        stop_ = true;
+                }
+                cv_.notify_all();
+                for (auto &w : workers_)
+                        w.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool &operator=(const ThreadPool&) = delete;
+
+        /**
+         * @brief size Number of worker threads (the caller is not counted).
+         */
+        inline std::size_t size() const
+        {
+                return workers_.size();
+        }
+
+        /**
+         * @brief submit Enqueue a task, fire and forget.
+         */
+        void submit(const std::function<void()> &task)
+        {
+                {
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        tasks_.push(task);
+                }
+                cv_.notify_one();
+        }
+
+        /**
+         * @brief parallelFor Runs body(i) for every i in [0, n) and returns when
+         * all of them are done.
+         *
+         * The calling thread takes part in the work, hence this never deadlocks,
+         * even when called from a task which is already running on the pool, or
+         * when all workers are busy. The first exception thrown by body is
+         * rethrown here.
+         */
+        void parallelFor(const std::size_t n, const std::function<void(std::size_t)> &body)
+        {
+                if (n == 0)
+                        return;
+                if (n == 1 || workers_.empty())
+                {
+                        for (std::size_t i = 0; i < n; ++i)
+                                body(i);
+                        return;
+                }
+                // helpers may start after we returned, so the shared state must
+                // outlive this call, they will just find no work left
+                std::shared_ptr<Loop> loop = std::make_shared<Loop>(n, body);
+                const std::size_t helpers = std::min(workers_.size(), n - 1);
+                for (std::size_t h = 0; h < helpers; ++h)
+                        submit([loop](){ loop->run(); });
+                loop->run();
+                std::unique_lock<std::mutex> lock(loop->mtx);
+                loop->cv.wait(lock, [&loop](){ return loop->done == loop->n; });
+                if (loop->error)
+                        std::rethrow_exception(loop->error);
+        }
+
+        /**
+         * @brief shared The process wide pool, sized on the available cores.
+         */
+        static ThreadPool &shared()
+        {
+                static ThreadPool pool(std::thread::hardware_concurrency() > 1 ?
+                                std::thread::hardware_concurrency() - 1 : 0);
+                return pool;
+        }
+
+private:
+        /**
+         * @brief The Loop struct Shared state of a parallelFor() call.
+         */
+        struct Loop
+        {
+                Loop(const std::size_t size, const std::function<void(std::size_t)> &b) :
+                        n(size), next(0), done(0), body(b) {}
+
+                void run()
+                {
+                        std::size_t i;
+                        while ((i = next++) < n)
+                        {
+                                try
+                                {
+                                        body(i);
+                                }
+                                catch (...)
+                                {
+                                        std::lock_guard<std::mutex> lock(mtx);
+                                        if (!error)
+                                                error = std::current_exception();
+                                }
+                                std::lock_guard<std::mutex> lock(mtx);
+                                if (++done == n)
+                                        cv.notify_all();
+                        }
+                }
+
+                const std::size_t n;
+                std::atomic<std::size_t> next;
+                std::size_t done;
+                std::function<void(std::size_t)> body;
+                std::exception_ptr error;
+                std::mutex mtx;
+                std::condition_variable cv;
+        };
+
+        void work()
+        {
+                while (true)
+                {
+                        std::function<void()> task;
+                        {
+                                std::unique_lock<std::mutex> lock(mtx_);
+                                cv_.wait(lock, [this](){ return stop_ || !tasks_.empty(); });
+                                if (stop_ && tasks_.empty())
+                                        return;
+                                task = std::move(tasks_.front());
+                                tasks_.pop();
+                        }
+                        task();
+                }
+        }
+
+        std::vector<std::thread> workers_;
+        std::queue<std::function<void()>> tasks_;
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        bool stop_;
+};
+
+}
+
+#endif
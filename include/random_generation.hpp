@@ -3,11 +3,93 @@
 
 #include <random>
 #include <cmath>
+#include <atomic>
+#include <cstdint>
 
 ///Simple functions to quickly get uniformely distributed numbers in given
-//intervals
-std::random_device _device_;
-std::mt19937_64 _engine_(_device_());
+//intervals.
+//Every thread draws from its own engine (stream). All the streams derive from
+//one seed, random unless setRandomSeed() is called, so a run is reproducible
+//when each thread also pins its stream with setRandomStream().
+
+/**
+ * @brief The seed shared by all streams and how many times it was set.
+ */
+inline std::atomic<std::uint64_t> &_random_seed_()
+{
+        static std::atomic<std::uint64_t> seed(std::random_device{}());
+        return seed;
+}
+inline std::atomic<std::uint64_t> &_random_generation_()
+{
+        static std::atomic<std::uint64_t> generation(0);
+        return generation;
+}
+
+/**
+ * @brief The engine of a thread and the stream it draws.
+ */
+struct RandomStream
+{
+        std::mt19937_64 engine;
+        std::uint64_t stream;
+        std::uint64_t generation;
+
+        RandomStream()
+        {
+                //threads which do not pin a stream take the next free one, far
+                //from the pinned ones
+                static std::atomic<std::uint64_t> next(1ull << 32);
+                stream = next++;
+                reseed();
+        }
+
+        void reseed()
+        {
+                generation = _random_generation_();
+                const std::uint64_t seed = _random_seed_();
+                std::seed_seq seq{static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32),
+                        static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32)};
+                engine.seed(seq);
+        }
+};
+
+inline RandomStream &_random_stream_()
+{
+        thread_local RandomStream s;
+        return s;
+}
+
+/**
+ * @brief The engine of the calling thread.
+ */
+inline std::mt19937_64 &randomEngine()
+{
+        RandomStream &s = _random_stream_();
+        if (s.generation != _random_generation_())
+                s.reseed();
+        return s.engine;
+}
+
+/**
+ * @brief Seed every stream, the ones already in use restart on their next draw.
+ */
+inline void setRandomSeed(const std::uint64_t seed)
+{
+        _random_seed_() = seed;
+        ++_random_generation_();
+}
+
+/**
+ * @brief Bind the calling thread to stream id (e.g. 0 for the main thread
+ * and the worker index plus one for workers) and restart it.
+ */
+inline void setRandomStream(const std::uint64_t id)
+{
+        RandomStream &s = _random_stream_();
+        s.stream = id;
+        s.reseed();
+}
 
 /**
  * @brief Get an uniformely distributed REAL number in [a, b) if inclusive=false,
@@ -18,11 +100,11 @@ double getRandIn(const double a, const double b, bool inclusive=false)
         if(inclusive){
                 std::uniform_real_distribution<double> dis(a,
                 std::nextafter(b, std::numeric_limits<double>::max()));
-                return (dis(_engine_));
+                return (dis(randomEngine()));
         }
         else{
                 std::uniform_real_distribution<double> dis(a,b);
-                return (dis(_engine_));
+                return (dis(randomEngine()));
         }
 }
 /**
@@ -31,7 +113,23 @@ double getRandIn(const double a, const double b, bool inclusive=false)
 int getRandIn(const int a, const int b)
 {
         std::uniform_int_distribution<int> dis(a,b);
-        return (dis(_engine_));
+        return (dis(randomEngine()));
+}
+
+/**
+ * @brief The i-th element of the Halton (van der Corput) sequence in base b,
+ * in [0, 1).
+ */
+inline double halton(std::uint64_t i, const unsigned int b)
+{
+        double f = 1.0, r = 0.0;
+        while (i > 0)
+        {
+                f /= b;
+                r += f*(i % b);
+                i /= b;
+        }
+        return r;
 }
 
 #endif
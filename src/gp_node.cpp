@@ -17,6 +17,8 @@ GaussianProcessNode::GaussianProcessNode (): nh(ros::NodeHandle("gaussian_proces
     simulate_touch(true), steps(0)
 {
     mtx_marks = std::make_shared<std::mutex>();
+    atlas_fresh = std::make_shared<gp_regression::Data>();
+    atlas_stale = false;
     srv_start = nh.advertiseService("start_process", &GaussianProcessNode::cb_start, this);
     srv_update = nh.advertiseService("update_process", &GaussianProcessNode::cb_updateS, this);
     srv_get_next_best_path_ = nh.advertiseService("get_next_best_path", &GaussianProcessNode::cb_get_next_best_path, this);
@@ -30,6 +32,28 @@ GaussianProcessNode::GaussianProcessNode (): nh(ros::NodeHandle("gaussian_proces
     nh.param<double>("global_goal", goal, 0.1);
     nh.param<double>("sample_res", sample_res, 0.07);
     nh.param<bool>("simulate_touch", simulate_touch, true);
+    nh.param<bool>("blocked_factorization", blocked_factorization, false);
+    nh.param<bool>("compressed_covariance", compressed_covariance, false);
+    nh.param<bool>("noise_spectrum", noise_spectrum, false);
+    nh.param<bool>("spatial_order", spatial_order, false);
+    nh.param<bool>("incremental_update", incremental_update, false);
+    nh.param<bool>("background_update", background_update, true);
+    nh.param<bool>("loo_diagnostics", loo_diagnostics, false);
+    nh.param<bool>("gradient_observations", gradient_observations, false);
+    nh.param<double>("gradient_sigma2", gradient_sigma2, 1e-1);
+    nh.param<int>("explorer_workers", explorer_workers, 1);
+    nh.param<int>("speculative_candidates", speculative_candidates, 1);
+    nh.param<bool>("quasi_random_sampling", quasi_random_sampling, false);
+    nh.param<bool>("adaptive_sampling", adaptive_sampling, false);
+    nh.param<double>("atlas_influence", atlas_influence, 0.3);
+    nh.param<double>("atlas_tolerance", atlas_tol, 1e-2);
+    int random_seed;
+    nh.param<int>("random_seed", random_seed, -1);
+    if (random_seed >= 0){
+        //reproducible runs
+        setRandomSeed(random_seed);
+        setRandomStream(0);
+    }
     synth_var_goal = 0.2;
 }
 
@@ -144,6 +168,8 @@ void GaussianProcessNode::reMeanAndDenormalizeData(const typename pcl::PointClou
 bool GaussianProcessNode::cb_get_next_best_path(gp_regression::GetNextBestPath::Request& req, gp_regression::GetNextBestPath::Response& res)
 {
     ros::Rate rate(10); //try to go at 10hz, as in the node
+    //use the last published model, an update still in progress is not waited for
+    checkModel();
     current_goal = req.var_desired.data;
     Eigen::Vector3d start_point;
     if (req.start_point.header.frame_id.empty())
@@ -215,6 +241,7 @@ bool GaussianProcessNode::cb_get_next_best_path(gp_regression::GetNextBestPath::
             if (simulate_touch && (synth_var_goal > goal)){
                 ROS_WARN("[GaussianProcessNode::%s]\tNo solution found at requested variance %g, automatically reducing it.",__func__, synth_var_goal);
                 synth_var_goal = (synth_var_goal - 0.1) < goal ? goal : synth_var_goal - 0.1;
+                //the retry resumes the current atlas at the lower goal
                 markers = boost::make_shared<visualization_msgs::MarkerArray>();
                 visualization_msgs::Marker samples;
                 samples.header.frame_id = proc_frame;
@@ -352,7 +379,7 @@ bool GaussianProcessNode::cb_get_next_best_path(gp_regression::GetNextBestPath::
         for (size_t i=0; i<solution.size(); ++i)
         {
             // ToDO: solutionToPath(solution, path) function
-            gp_atlas_rrt::Chart chart = atlas->getNode(solution[i]);
+            const gp_atlas_rrt::Chart &chart = atlas->getNode(solution[i]);
             Eigen::Vector3d point_eigen = chart.getCenter();
             Eigen::Vector3d normal_eigen = chart.getNormal();
             // modifies the point
@@ -363,7 +390,7 @@ bool GaussianProcessNode::cb_get_next_best_path(gp_regression::GetNextBestPath::
                 //insert a geodesic intermediate point between nodes
                 //Atlas generates always at least two nodes
                 if (i>0){
-                    gp_atlas_rrt::Chart prev_chart = atlas->getNode(solution[i-1]);
+                    const gp_atlas_rrt::Chart &prev_chart = atlas->getNode(solution[i-1]);
                     Eigen::Vector3d p1 = prev_chart.getCenter();
                     Eigen::Vector3d n1 = prev_chart.getNormal();
                     Eigen::Vector3d p2 = point_eigen;
@@ -448,9 +475,14 @@ bool GaussianProcessNode::cb_start(gp_regression::StartProcess::Request& req, gp
     predicted_shape_.triangles.clear();
     reg_.reset();
     obj_gp.reset();
+    models.reset();
+    views.reset();
+    std::atomic_store(&built_views, ModelViews::ConstPtr());
     my_kernel.reset();
     atlas.reset();
     explorer.reset();
+    atlas_fresh = std::make_shared<gp_regression::Data>();
+    atlas_stale = false;
     solution.clear();
     markers.reset();
     steps = 0;
@@ -606,9 +638,7 @@ bool GaussianProcessNode::cb_start(gp_regression::StartProcess::Request& req, gp
             //publish training set
             publishCloudModel();
             ros::spinOnce();
-            //initialize objects involved
-            markers = boost::make_shared<visualization_msgs::MarkerArray>();
-            //show ground truth at start
+            //show ground truth at start, along with the samples
             if (simulate_touch){
                 visualization_msgs::Marker mesh;
                 mesh.header.frame_id = proc_frame;
@@ -631,10 +661,6 @@ bool GaussianProcessNode::cb_start(gp_regression::StartProcess::Request& req, gp
                 markers->markers.push_back(mesh);
             }
             // marchingSampling(true, 0.06,0.02);
-            //perform fake sampling
-            fakeDeterministicSampling(true, 1.01, sample_res);
-            computeOctomap();
-            computePredictedShapeMsg();
             res.predicted_shape = predicted_shape_;
             return true;
         }
@@ -645,6 +671,9 @@ bool GaussianProcessNode::cb_updateS(gp_regression::Update::Request &req, gp_reg
     gp_regression::Path::Ptr msg = boost::make_shared<gp_regression::Path>();
     *msg = req.explored_points;
     cb_update(msg);
+    //the response carries the new shape, so wait for it
+    models.wait();
+    checkModel();
     res.predicted_shape = predicted_shape_;
     return true;
 }
@@ -670,6 +699,28 @@ void GaussianProcessNode::cb_update(const gp_regression::Path::ConstPtr &msg)
             pt.z = msg->points[i].point.z;
             colorIt(0,255,255, pt);
             object_ptr->push_back(pt);
+            //on a touched point the direction is the outward unit normal
+            //measured at the contact (the hand moves along its opposite), which
+            //is the gradient of the labels: 0 on the surface, 1 outside.
+            //It is not the approach suggested by the model, or the model would
+            //be conditioned on its own prediction
+            if (gradient_observations && msg->directions.size() == msg->points.size()){
+                Eigen::Vector3d n(
+                        msg->directions[i].vector.x,
+                        msg->directions[i].vector.y,
+                        msg->directions[i].vector.z
+                        );
+                if (n.norm() > 0){
+                    n.normalize();
+                    touch_normals->coord_x.push_back(pt.x);
+                    touch_normals->coord_y.push_back(pt.y);
+                    touch_normals->coord_z.push_back(pt.z);
+                    touch_normals->grad_x.push_back(n[0]);
+                    touch_normals->grad_y.push_back(n[1]);
+                    touch_normals->grad_z.push_back(n[2]);
+                    touch_normals->sigma2.push_back(gradient_sigma2);
+                }
+            }
         }
         else{
             //we need a new transform to compute externals
@@ -693,7 +744,48 @@ void GaussianProcessNode::cb_update(const gp_regression::Path::ConstPtr &msg)
     fresh_data->sigma2.push_back(5e-2);
     */
 
-    deMeanAndNormalizeData( object_ptr, data_ptr_ );
+    //if the touched points fit into the current normalization the model can be
+    //updated in place, otherwise centroid and scale have to be recomputed
+    gp_regression::Data::Ptr fresh_data = std::make_shared<gp_regression::Data>();
+    //with normals the joint covariance is solved again anyway
+    bool incremental = incremental_update && !gradient_observations && obj_gp && reg_ && views;
+    for (size_t i=0; i< msg->points.size() && incremental; ++i)
+    {
+        if (!msg->isOnSurface[i].data)
+            continue;
+        Eigen::Vector3d point(
+                msg->points[i].point.x,
+                msg->points[i].point.y,
+                msg->points[i].point.z
+                );
+        deMeanAndNormalizeData(point);
+        if (point.norm() > 1.0){
+            incremental = false;
+            break;
+        }
+        fresh_data->coord_x.push_back(point[0]);
+        fresh_data->coord_y.push_back(point[1]);
+        fresh_data->coord_z.push_back(point[2]);
+        fresh_data->label.push_back(0.0);
+        fresh_data->sigma2.push_back(sigma2);
+    }
+    if (incremental){
+        for (size_t i=0; i< fresh_data->label.size(); ++i)
+        {
+            pcl::PointXYZRGB pt;
+            pt.x = fresh_data->coord_x[i];
+            pt.y = fresh_data->coord_y[i];
+            pt.z = fresh_data->coord_z[i];
+            colorIt(0,255,255, pt);
+            data_ptr_->push_back(pt);
+        }
+    }
+    else{
+        fresh_data->clear();
+        deMeanAndNormalizeData( object_ptr, data_ptr_ );
+        //the atlas is in the old normalization
+        atlas_stale = true;
+    }
     //now we can add the externals
     model_ptr->resize(ext_size);
     for (size_t i=0; i< msg->points.size(); ++i)
@@ -718,6 +810,13 @@ void GaussianProcessNode::cb_update(const gp_regression::Path::ConstPtr &msg)
             ext_gp->coord_z.push_back(pt.z);
             ext_gp->label.push_back(dist);
             ext_gp->sigma2.push_back(sigma2);
+            if (incremental){
+                fresh_data->coord_x.push_back(pt.x);
+                fresh_data->coord_y.push_back(pt.y);
+                fresh_data->coord_z.push_back(pt.z);
+                fresh_data->label.push_back(dist);
+                fresh_data->sigma2.push_back(sigma2);
+            }
             // add external point to rviz
             colorIt(100,0,50, pt);
             model_ptr->push_back(pt);
@@ -733,8 +832,8 @@ void GaussianProcessNode::cb_update(const gp_regression::Path::ConstPtr &msg)
         points(i,1) = p[1];
         points(i,2) = p[2];
     }
-    //update full model
-    if (simulate_touch){
+    //update full model, unless the normalization is unchanged
+    if (simulate_touch && !incremental){
         pcl::PointCloud<pcl::PointXYZ> tmp;
         pcl::demeanPointCloud(*full_object_real, current_offset_, tmp);
         Eigen::Matrix4f t;
@@ -748,18 +847,50 @@ void GaussianProcessNode::cb_update(const gp_regression::Path::ConstPtr &msg)
     }
     //start recomputing GP
     prepareData();
+    if (incremental && atlas)
+        for (size_t i=0; i< fresh_data->label.size(); ++i)
+        {
+            atlas_fresh->coord_x.push_back(fresh_data->coord_x[i]);
+            atlas_fresh->coord_y.push_back(fresh_data->coord_y[i]);
+            atlas_fresh->coord_z.push_back(fresh_data->coord_z[i]);
+        }
+    if (incremental){
+        //with an unchanged normalization the current model stays valid
+        //meanwhile, so it can be used until the update is published
+        updateGP(fresh_data);
+        if (background_update){
+            publishCloudModel();
+            ROS_INFO("[GaussianProcessNode::%s]\tIntegrating %ld new points in background.",__func__, fresh_data->label.size());
+            return;
+        }
+        models.wait();
+        checkModel();
+        return;
+    }
     computeGP();
     //visualize training data
     publishCloudModel();
-    ros::spinOnce();
-    //initialize objects involved
+    return;
+}
+
+void GaussianProcessNode::checkModel()
+{
+    const ModelViews::ConstPtr next = std::atomic_load(&built_views);
+    if (!next || next == views)
+        return;
+    //everything was sampled on the builder thread, the service callbacks and
+    //this loop only switch to it
+    views = next;
+    obj_gp = views->model;
+    real_explicit_ptr = views->real_explicit;
+    min_v = views->min_v;
+    max_v = views->max_v;
+    octomap = views->octomap;
+    predicted_shape_ = views->predicted_shape;
     markers = boost::make_shared<visualization_msgs::MarkerArray>();
     // createTouchMarkers(points); //UGLY, no time to beautify it
-    //perform fake sampling
-    fakeDeterministicSampling(true, 1.01, sample_res);
-    computeOctomap();
-    computePredictedShapeMsg();
-    return;
+    markers->markers.push_back(views->samples);
+    ROS_INFO("[GaussianProcessNode::%s]\tSwitched to a new model, %ld points on its surface.",__func__, real_explicit_ptr->size());
 }
 void
 GaussianProcessNode::createTouchMarkers(const Eigen::MatrixXd &pts)
@@ -795,6 +926,7 @@ void GaussianProcessNode::prepareExtData()
     if (!model_ptr->empty())
         model_ptr->clear();
     ext_gp = std::make_shared<gp_regression::Data>();
+    touch_normals = std::make_shared<gp_regression::GradientData>();
 
     ext_size = 0;
     /*
@@ -912,17 +1044,80 @@ bool GaussianProcessNode::computeGP()
         data_gp->label.push_back(ext_gp->label[i]);
         data_gp->sigma2.push_back(ext_gp->sigma2[i]);
     }
+    //normals are unit gradients of the (normalized) distance the labels follow
+    gp_regression::GradientData::Ptr gradients_gp;
+    if (gradient_observations && touch_normals && !touch_normals->coord_x.empty()){
+        gradients_gp = std::make_shared<gp_regression::GradientData>(*touch_normals);
+        for (size_t i =0; i<gradients_gp->coord_x.size(); ++i)
+        {
+            Eigen::Vector3d p(
+                    gradients_gp->coord_x[i],
+                    gradients_gp->coord_y[i],
+                    gradients_gp->coord_z[i]
+                    );
+            deMeanAndNormalizeData(p);
+            gradients_gp->coord_x[i] = p[0];
+            gradients_gp->coord_y[i] = p[1];
+            gradients_gp->coord_z[i] = p[2];
+        }
+    }
 
-    obj_gp = std::make_shared<gp_regression::Model>();
     reg_ = std::make_shared<gp_regression::ThinPlateRegressor>();
     // my_kernel = std::make_shared<gp_regression::ThinPlate>(out_sphere_rad * 2);
     my_kernel = std::make_shared<gp_regression::ThinPlate>(2.0);
     reg_->setCovFunction(my_kernel);
-    const bool withoutNormals = false;
-    reg_->create<withoutNormals>(data_gp, obj_gp);
+    reg_->setQueryOrdering(spatial_order);
+    const gp_regression::ThinPlateRegressor::ConstPtr reg = reg_;
+    const bool blocked = blocked_factorization;
+    const bool compressed = compressed_covariance;
+    const bool spectral = noise_spectrum;
+    const bool sorted = spatial_order;
+    const Eigen::Vector3d offset = current_offset_.head<3>();
+    const double scale = current_scale_;
+    const std::string frame_id = proc_frame;
+    const double pass = sample_res;
+    models.rebuild([this, reg, data_gp, gradients_gp, blocked, compressed, spectral, sorted, offset, scale, frame_id, pass](gp_regression::Model::ConstPtr) -> gp_regression::Model::Ptr
+    {
+        gp_regression::Model::Ptr gp = std::make_shared<gp_regression::Model>();
+        gp->spatial_order = sorted;
+        if (blocked)
+            gp->factorization = gp_regression::Factorization::BLOCKED_LDLT;
+        if (compressed)
+            gp->factorization = gp_regression::Factorization::HODLR;
+        if (spectral)
+            gp->factorization = gp_regression::Factorization::EIGEN;
+        const bool withoutNormals = false;
+        reg->create<withoutNormals>(data_gp, gradients_gp, gp);
+        //sampled here, switching to it costs nothing
+        std::atomic_store(&built_views, ModelViews::ConstPtr(
+                    sampleViews(reg, gp, ModelViews::ConstPtr(), offset, scale, frame_id, pass)));
+        return gp;
+    });
+    //the normalization changed, there is nothing to use meanwhile
+    models.wait();
+    checkModel();
+    if (!obj_gp){
+        ROS_ERROR("[GaussianProcessNode::%s]\tModel creation failed.",__func__);
+        return false;
+    }
     auto end_time = std::chrono::high_resolution_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - begin_time).count();
     ROS_INFO("[GaussianProcessNode::%s]\tRegressor and Model created using %ld training points. Total time consumed: %ld milliseconds.", __func__, cloud_gp->label.size(), elapsed );
+    if (loo_diagnostics){
+        std::vector<double> loo_mu, loo_var;
+        const double loo_lik = reg_->leaveOneOut(obj_gp, loo_mu, loo_var);
+        //points with no finite leave-one-out mean are left out of the RMSE
+        double rmse(0.0);
+        size_t finite(0);
+        for (size_t i=0; i<loo_mu.size(); ++i)
+            if (std::isfinite(loo_mu[i])){
+                rmse += std::pow(data_gp->label[i] - loo_mu[i], 2);
+                ++finite;
+            }
+        rmse = finite > 0 ? std::sqrt(rmse / finite) : std::numeric_limits<double>::quiet_NaN();
+        ROS_INFO("[GaussianProcessNode::%s]\tLeave-one-out log likelihood %g, RMSE %g over %zu of %zu points.",
+                __func__, loo_lik, rmse, finite, loo_mu.size());
+    }
     //make some adjustments to training set, if we are slowing down
     // if (elapsed > 600){
     //     sample_res = sample_res < 0.13 ? sample_res + 0.01 : 0.13;
@@ -938,6 +1133,40 @@ bool GaussianProcessNode::computeGP()
     return true;
 }
 
+bool GaussianProcessNode::updateGP(const gp_regression::Data::ConstPtr &fresh_data)
+{
+    if (!obj_gp || !reg_ || !fresh_data || fresh_data->label.empty())
+        return false;
+    const gp_regression::ThinPlateRegressor::ConstPtr reg = reg_;
+    //the normalization is unchanged by an update
+    const Eigen::Vector3d offset = current_offset_.head<3>();
+    const double scale = current_scale_;
+    const std::string frame_id = proc_frame;
+    const double pass = sample_res;
+    //readers may hold the current model, so the update goes on a copy of it
+    models.rebuild([this, reg, fresh_data, offset, scale, frame_id, pass](gp_regression::Model::ConstPtr current) -> gp_regression::Model::Ptr
+    {
+        if (!current)
+            return gp_regression::Model::Ptr();
+        auto begin_time = std::chrono::high_resolution_clock::now();
+        gp_regression::Model::Ptr gp = std::make_shared<gp_regression::Model>(*current);
+        const bool withoutNormals = false;
+        reg->update<withoutNormals>(fresh_data, gp);
+        auto end_time = std::chrono::high_resolution_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - begin_time).count();
+        ROS_INFO("[GaussianProcessNode::updateGP]\tModel updated with %ld new training points. Total time consumed: %ld milliseconds.", fresh_data->label.size(), elapsed );
+        //builds are serialized, so the last views built are those of current,
+        //unless it was never sampled
+        ModelViews::ConstPtr previous = std::atomic_load(&built_views);
+        if (previous && previous->model != current)
+            previous.reset();
+        std::atomic_store(&built_views, ModelViews::ConstPtr(
+                    sampleViews(reg, gp, previous, offset, scale, frame_id, pass)));
+        return gp;
+    });
+    return true;
+}
+
 //
 bool GaussianProcessNode::startExploration(const float v_des, Eigen::Vector3d &start)
 {
@@ -951,12 +1180,39 @@ bool GaussianProcessNode::startExploration(const float v_des, Eigen::Vector3d &s
         return false;
     }
 
+    //keep the atlas of the last exploration, if the model was only updated
+    //since then: charts far from the new points are still valid. A changed
+    //variance goal is checked by the explorer on the charted nodes first
+    if (atlas && explorer && !atlas_stale){
+        if (atlas->getGPModel() != obj_gp){
+            atlas->setGPRegressor(reg_);
+            const std::size_t refreshed = atlas->revalidate(obj_gp, atlas_fresh, atlas_influence, atlas_tol);
+            ROS_INFO("[GaussianProcessNode::%s]\tAtlas moved to the new model, %zu charts replaced",
+                    __func__, refreshed);
+            //points of an update still in progress are needed next time too
+            if (!models.isBuilding())
+                atlas_fresh->clear();
+        }
+        atlas->setVarianceTolGoal( v_des );
+        explorer->setMarkers(markers, mtx_marks, proc_frame);
+        explorer->startExploration();
+        exploration_started = true;
+        ROS_INFO("[GaussianProcessNode::%s]\tExploration resumed at variance goal %g", __func__, v_des);
+        return true;
+    }
+    atlas_stale = false;
+    atlas_fresh->clear();
+
     //create the atlas
     atlas = std::make_shared<gp_atlas_rrt::AtlasCollision>(obj_gp, reg_);
     //termination condition
     atlas->setVarianceTolGoal( v_des );
     //factor to control disc radius
     atlas->setVarRadiusFactor( 0.3 );
+    //candidate samples projected together on each expansion
+    atlas->setSpeculativeCandidates(speculative_candidates > 0 ? speculative_candidates : 1);
+    atlas->setQuasiRandomSampling(quasi_random_sampling);
+    atlas->setAdaptiveSampling(adaptive_sampling);
     //atlas is ready
 
     //setup explorer
@@ -966,6 +1222,7 @@ bool GaussianProcessNode::startExploration(const float v_des, Eigen::Vector3d &s
     explorer->setMaxNodes(300);
     explorer->setNoSampleMarkers(true);
     explorer->setBias(0.4); //probability of expanding on an old node
+    explorer->setWorkers(explorer_workers > 0 ? explorer_workers : 1);
     if (start.isZero()){
         //get a random starting point from data cloud
         int r_id = getRandIn(0, data_ptr_->points.size()-1 );
@@ -989,20 +1246,45 @@ void GaussianProcessNode::checkExploration()
         solution = explorer->getSolution();
         explorer->stopExploration();
         exploration_started = false;
+        //only chart geometry is needed from now on
+        atlas->releaseSamples();
         if (!solution.empty())
             ROS_INFO("[GaussianProcessNode::%s]\tSolution Found", __func__);
     }
 }
 
-// for visualization purposes
-void GaussianProcessNode::fakeDeterministicSampling(const bool first_time, const double scale, const double pass)
+// for visualization purposes, on the builder thread: nothing is published here
+ModelViews::Ptr
+GaussianProcessNode::sampleViews(const gp_regression::ThinPlateRegressor::ConstPtr &reg,
+        const gp_regression::Model::ConstPtr &gp, const ModelViews::ConstPtr &previous,
+        const Eigen::Vector3d &offset, const double scale, const std::string &frame_id, const double pass)
 {
     auto begin_time = std::chrono::high_resolution_clock::now();
-    if(!markers)
-        return;
+    ModelViews::Ptr views = std::make_shared<ModelViews>();
+    views->model = gp;
+    views->real_explicit = boost::make_shared<pcl::PointCloud<pcl::PointXYZI>>();
+    views->real_explicit->header.frame_id = frame_id;
+    //only the correction for the new points if gp is an update of the
+    //model previous was sampled on
+    if (previous && gp->last_update.p > 0 && !previous->grid_q.empty())
+        refreshDeterministicSampling(reg, *previous, *views);
+    else
+        fakeDeterministicSampling(reg, *views, 1.01, pass);
+    ROS_INFO("[GaussianProcessNode::%s]\tFound %ld points approximately on GP surface.",__func__,
+            views->real_explicit->size());
 
-    visualization_msgs::Marker samples;
-    samples.header.frame_id = proc_frame;
+    views->min_v = 10.0;
+    views->max_v = 0.0;
+    for (const auto &pt : views->real_explicit->points)
+    {
+        if (pt.intensity <= views->min_v)
+            views->min_v = pt.intensity;
+        if (pt.intensity >= views->max_v)
+            views->max_v = pt.intensity;
+    }
+
+    visualization_msgs::Marker &samples = views->samples;
+    samples.header.frame_id = frame_id;
     samples.header.stamp = ros::Time();
     samples.lifetime = ros::Duration(5.0);
     samples.ns = "samples";
@@ -1012,90 +1294,120 @@ void GaussianProcessNode::fakeDeterministicSampling(const bool first_time, const
     samples.scale.x = 0.025;
     samples.scale.y = 0.025;
     samples.scale.z = 0.025;
-    markers->markers.push_back(samples);
+    const double min_v = views->min_v, max_v = views->max_v;
+    const double mid_v = ( min_v + max_v ) * 0.5;
+    for (const auto &ptc: views->real_explicit->points)
+    {
+        geometry_msgs::Point pt;
+        std_msgs::ColorRGBA cl;
+        pt.x = ptc.x;
+        pt.y = ptc.y;
+        pt.z = ptc.z;
+        cl.a = 1.0;
+        cl.b = 0.0;
+        cl.r = (ptc.intensity<mid_v) ? 1/(mid_v - min_v) * (ptc.intensity - min_v) : 1.0;
+        cl.g = (ptc.intensity>mid_v) ? -1/(max_v - mid_v) * (ptc.intensity - mid_v) + 1 : 1.0;
+        samples.points.push_back(pt);
+        samples.colors.push_back(cl);
+    }
 
-    real_explicit_ptr = boost::make_shared<pcl::PointCloud<pcl::PointXYZI>>();
-    real_explicit_ptr->header.frame_id = proc_frame;
-    predicted_shape_.triangles.clear();
-    predicted_shape_.vertices.clear();
+    //octomap and mesh are in the real world
+    pcl::PointCloud<pcl::PointXYZI>::Ptr real_explicit =
+        boost::make_shared<pcl::PointCloud<pcl::PointXYZI>>();
+    real_explicit->header = views->real_explicit->header;
+    Eigen::Matrix4f t;
+    t    << scale, 0, 0, offset(0),
+            0, scale, 0, offset(1),
+            0, 0, scale, offset(2),
+            0, 0, 0,          1;
+    pcl::transformPointCloud(*views->real_explicit, *real_explicit, t);
+    computeOctomap(real_explicit, *views);
+    computePredictedShapeMsg(*real_explicit, *views);
 
-    size_t count(0);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - begin_time).count();
+    ROS_INFO("[GaussianProcessNode::%s]\tTotal time consumed: %ld milliseconds.", __func__, elapsed );
+    return views;
+}
+
+// the grid plotting
+void GaussianProcessNode::fakeDeterministicSampling(const gp_regression::ThinPlateRegressor::ConstPtr &reg,
+        ModelViews &views, const double scale, const double pass)
+{
     const auto total = std::floor( std::pow((2*scale+1)/pass, 3) );
     ROS_INFO("[GaussianProcessNode::%s]\tSampling %g grid points on GP ...",__func__, total);
     for (double x = -scale; x<= scale; x += pass)
     {
-        std::vector<std::thread> threads;
+        //one batched evaluation per grid slice
+        gp_regression::Data::Ptr qq = std::make_shared<gp_regression::Data>();
         for (double y = -scale; y<= scale; y += pass)
         {
             for (double z = -scale; z<= scale; z += pass)
             {
-                ++count;
-                std::cout<<" -> "<<count<<"/"<<total<<"\r";
-                threads.emplace_back(&GaussianProcessNode::samplePoint, this, x,y,z, std::ref(samples));
+                qq->coord_x.push_back(x);
+                qq->coord_y.push_back(y);
+                qq->coord_z.push_back(z);
             }
         }
-        for (auto &t: threads)
-            t.join();
-        //update visualization
-        publishAtlas();
-        ros::spinOnce();
+        gp_regression::EvalOutput out;
+        reg->evaluate<gp_regression::EVAL_MEAN>(views.model, qq, out);
+        //variance is only computed when a point is found on the surface
+        out.v.assign(out.f.size(), std::numeric_limits<double>::quiet_NaN());
+        views.grid_q.push_back(qq);
+        views.grid_out.push_back(out);
+        sampleSurface(reg, views.grid_q.back(), views.grid_out.back(), views);
     }
-    std::cout<<std::endl;
-
-    ROS_INFO("[GaussianProcessNode::%s]\tFound %ld points approximately on GP surface.",__func__,
-            real_explicit_ptr->size());
+}
 
-    if (first_time){
-        min_v = 10.0;
-        max_v = 0.0;
-        for (const auto &pt : real_explicit_ptr->points)
-        {
-            if (pt.intensity <= min_v)
-                min_v = pt.intensity;
-            if (pt.intensity >= max_v)
-                max_v = pt.intensity;
-        }
+// same as above, but it corrects the grid of previous for the last model
+// update instead of evaluating it again
+void GaussianProcessNode::refreshDeterministicSampling(const gp_regression::ThinPlateRegressor::ConstPtr &reg,
+        const ModelViews &previous, ModelViews &views)
+{
+    //the queries are shared, the fields are corrected on a copy
+    views.grid_q = previous.grid_q;
+    views.grid_out = previous.grid_out;
+    for (size_t i=0; i<views.grid_q.size(); ++i)
+    {
+        reg->refresh(views.model, views.grid_q[i], views.grid_out[i]);
+        sampleSurface(reg, views.grid_q[i], views.grid_out[i], views);
     }
-
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(end_time - begin_time).count();
-    ROS_INFO("[GaussianProcessNode::%s]\tTotal time consumed: %ld seconds.", __func__, elapsed );
-    // if (elapsed > 60)
-    //     sample_res = sample_res < 0.1 ? sample_res + 0.01 : 0.1;
 }
+
 void
-GaussianProcessNode::samplePoint(const double x, const double y, const double z, visualization_msgs::Marker &samp)
+GaussianProcessNode::sampleSurface(const gp_regression::ThinPlateRegressor::ConstPtr &reg,
+        const gp_regression::Data::ConstPtr &grid, gp_regression::EvalOutput &field, ModelViews &views)
 {
+    //points on the surface, and those among them with unknown variance
+    std::vector<size_t> surf, unknown;
     gp_regression::Data::Ptr qq = std::make_shared<gp_regression::Data>();
-    qq->coord_x.push_back(x);
-    qq->coord_y.push_back(y);
-    qq->coord_z.push_back(z);
-    std::vector<double> ff,vv;
-    reg_->evaluate(obj_gp, qq, ff, vv);
-    if (std::abs(ff.at(0)) <= 0.01) {
-        const double mid_v = ( min_v + max_v ) * 0.5;
-        geometry_msgs::Point pt;
-        std_msgs::ColorRGBA cl;
+    for (size_t i=0; i<field.f.size(); ++i)
+    {
+        if (std::abs(field.f[i]) > 0.01)
+            continue;
+        surf.push_back(i);
+        if (std::isnan(field.v[i])){
+            unknown.push_back(i);
+            qq->coord_x.push_back(grid->coord_x[i]);
+            qq->coord_y.push_back(grid->coord_y[i]);
+            qq->coord_z.push_back(grid->coord_z[i]);
+        }
+    }
+    if (!unknown.empty()){
+        gp_regression::EvalOutput out;
+        reg->evaluate<gp_regression::EVAL_VAR>(views.model, qq, out);
+        for (size_t k=0; k<unknown.size(); ++k)
+            field.v[unknown[k]] = out.v[k];
+    }
+    for (const auto i: surf)
+    {
         pcl::PointXYZI pt_pcl;
-        pt.x = x;
-        pt.y = y;
-        pt.z = z;
-        cl.a = 1.0;
-        cl.b = 0.0;
-        cl.r = (vv[0]<mid_v) ? 1/(mid_v - min_v) * (vv[0] - min_v) : 1.0;
-        cl.g = (vv[0]>mid_v) ? -1/(max_v - mid_v) * (vv[0] - mid_v) + 1 : 1.0;
-        pt_pcl.x = x;
-        pt_pcl.y = y;
-        pt_pcl.z = z;
+        pt_pcl.x = grid->coord_x[i];
+        pt_pcl.y = grid->coord_y[i];
+        pt_pcl.z = grid->coord_z[i];
         //intensity is variance
-        pt_pcl.intensity = vv[0];
-        //locks
-        std::lock_guard<std::mutex> lock (*mtx_marks);
-        std::lock_guard<std::mutex> lk (mtx_samp);
-        samp.points.push_back(pt);
-        samp.colors.push_back(cl);
-        real_explicit_ptr->push_back(pt_pcl);
-        markers->markers[markers->markers.size()-1] = samp;
+        pt_pcl.intensity = field.v[i];
+        views.real_explicit->push_back(pt_pcl);
     }
 }
 
@@ -1213,14 +1525,15 @@ GaussianProcessNode::marchingCubes(pcl::PointXYZ start, const float leaf, const
                 qq->coord_x.push_back(x);
                 qq->coord_y.push_back(y);
                 qq->coord_z.push_back(z);
-                std::vector<double> ff,vv;
-                reg_->evaluate(obj_gp, qq, ff, vv);
-                if (std::abs(ff.at(0)) <= 0.01) {
+                gp_regression::EvalOutput out;
+                reg_->evaluate<gp_regression::EVAL_MEAN>(obj_gp, qq, out);
+                if (std::abs(out.f.at(0)) <= 0.01) {
+                    reg_->evaluate<gp_regression::EVAL_VAR>(obj_gp, qq, out);
                     pcl::PointXYZI pt;
                     pt.x = x;
                     pt.y = y;
                     pt.z = z;
-                    pt.intensity = vv.at(0);
+                    pt.intensity = out.v.at(0);
                     geometry_msgs::Point p;
                     std_msgs::ColorRGBA cl;
                     p.x = x;
@@ -1292,13 +1605,11 @@ GaussianProcessNode::marchingCubes(pcl::PointXYZ start, const float leaf, const
 }
 
 void
-GaussianProcessNode::computeOctomap()
+GaussianProcessNode::computeOctomap(const pcl::PointCloud<pcl::PointXYZI>::Ptr &real_explicit, ModelViews &views)
 {
-    octomap = std::make_shared<octomap::OcTree>(0.01);
-    pcl::PointCloud<pcl::PointXYZI>::Ptr real_explicit =
-        boost::make_shared<pcl::PointCloud<pcl::PointXYZI>>();
+    const double min_v = views.min_v, max_v = views.max_v;
+    views.octomap = std::make_shared<octomap::OcTree>(0.01);
     pcl::PointCloud<pcl::PointXYZI> real_ds;
-    reMeanAndDenormalizeData(real_explicit_ptr, *real_explicit);
     pcl::VoxelGrid<pcl::PointXYZI> vg;
     vg.setInputCloud(real_explicit);
     vg.setLeafSize(0.005, 0.005, 0.005);
@@ -1317,7 +1628,7 @@ GaussianProcessNode::computeOctomap()
     {
         float hit = -8/(10*(max_v-min_v))*(pt.intensity- min_v) + 9/10;
         octomap::point3d opt (pt.x, pt.y, pt.z);
-        octomap->updateNode(opt, std::log10(hit/(1-hit)), false);
+        views.octomap->updateNode(opt, std::log10(hit/(1-hit)), false);
     }
 
     //TODO what about free(unoccupied) voxels, can they be
@@ -1325,13 +1636,8 @@ GaussianProcessNode::computeOctomap()
 }
 
 void
-GaussianProcessNode::computePredictedShapeMsg()
+GaussianProcessNode::computePredictedShapeMsg(const pcl::PointCloud<pcl::PointXYZI> &real_explicit, ModelViews &views)
 {
-
-    pcl::PointCloud<pcl::PointXYZI> real_explicit;
-    real_explicit.header = real_explicit_ptr->header;
-    reMeanAndDenormalizeData(real_explicit_ptr, real_explicit);
-
     // Followed this tutorial to compute the mesh: http://www.pointclouds.org/assets/icra2012/surface.pdf
     pcl::NormalEstimation<pcl::PointXYZ, pcl::Normal> n;
     pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal>);
@@ -1398,7 +1704,7 @@ GaussianProcessNode::computePredictedShapeMsg()
         p.x = pt.x;
         p.y = pt.y;
         p.z = pt.z;
-        predicted_shape_.vertices.push_back(p);
+        views.predicted_shape.vertices.push_back(p);
     }
     // and then the faces
     // ToDO: check that the normal is pointing outwards
@@ -1409,7 +1715,7 @@ GaussianProcessNode::computePredictedShapeMsg()
         t.vertex_indices.at(0) = v.vertices.at( 0 );
         t.vertex_indices.at(1) = v.vertices.at( 1 );
         t.vertex_indices.at(2) = v.vertices.at( 2 );
-        predicted_shape_.triangles.push_back( t );
+        views.predicted_shape.triangles.push_back( t );
     }
 }
 
@@ -1442,9 +1748,9 @@ GaussianProcessNode::synthTouch(const gp_regression::Path &sol)
         qq->coord_x.push_back(p[0]);
         qq->coord_y.push_back(p[1]);
         qq->coord_z.push_back(p[2]);
-        std::vector<double> ff,vv;
-        Eigen::MatrixXd G;
-        reg_->evaluate(obj_gp, qq, ff, vv, G);
+        gp_regression::EvalOutput out;
+        reg_->evaluate<gp_regression::EVAL_GRAD>(obj_gp, qq, out);
+        const Eigen::MatrixXd &G = out.N;
         if (!G.row(0).isMuchSmallerThan(1e3, 1e-1) || G.row(0).isZero(1e-5)){
             ROS_WARN("[GaussianProcessNode::%s]\tGradien is wrong ignoring it.",__func__);
             n = Eigen::Vector3d::UnitX();
@@ -1507,9 +1813,9 @@ GaussianProcessNode::synthTouch(const gp_regression::Path &sol)
                 qq->coord_x.push_back(start[0]);
                 qq->coord_y.push_back(start[1]);
                 qq->coord_z.push_back(start[2]);
-                std::vector<double> ff,vv;
-                Eigen::MatrixXd G;
-                reg_->evaluate(obj_gp, qq, ff, vv, G);
+                gp_regression::EvalOutput out;
+                reg_->evaluate<gp_regression::EVAL_GRAD>(obj_gp, qq, out);
+                const Eigen::MatrixXd &G = out.N;
                 if (!G.row(0).isMuchSmallerThan(1e3, 1e-1) || G.row(0).isZero(1e-5)){
                     ROS_WARN("[GaussianProcessNode::%s]\tGradien is wrong ignoring it.",__func__);
                 }
@@ -1562,6 +1868,27 @@ GaussianProcessNode::raycast(Eigen::Vector3d &point, const Eigen::Vector3d &norm
             d.data = 0.0;
             touched.isOnSurface.push_back(iof);
             touched.distances.push_back(d);
+            //what the hand would feel is the normal of the real surface, not
+            //the one the model predicts: fit a plane to the object around the
+            //contact and turn it against the ray, which comes from outside.
+            //A zero normal means it could not be measured.
+            Eigen::Vector3d true_normal = Eigen::Vector3d::Zero();
+            std::vector<int> n_id;
+            std::vector<float> n_dist;
+            if (kd_full.radiusSearch(full_object->points[k_id[0]], 0.1, n_id, n_dist) >= 3){
+                Eigen::Matrix3f cov;
+                Eigen::Vector4f centroid;
+                pcl::computeMeanAndCovarianceMatrix(*full_object, n_id, cov, centroid);
+                Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> eig(cov);
+                true_normal = eig.eigenvectors().col(0).cast<double>();
+                if (true_normal.dot(normal) < 0)
+                    true_normal = -true_normal;
+            }
+            geometry_msgs::Vector3Stamped n;
+            n.vector.x = true_normal[0];
+            n.vector.y = true_normal[1];
+            n.vector.z = true_normal[2];
+            touched.directions.push_back(n);
             ROS_INFO("[GaussianProcessNode::%s]\tTouched the object!!",__func__);
             return norm_p;
         }
@@ -1594,6 +1921,11 @@ GaussianProcessNode::raycast(Eigen::Vector3d &point, const Eigen::Vector3d &norm
                 std_msgs::Float32 d;
                 d.data = dist*current_scale_;
                 touched.distances.push_back(d);
+                geometry_msgs::Vector3Stamped n;
+                n.vector.x = normal[0];
+                n.vector.y = normal[1];
+                n.vector.z = normal[2];
+                touched.directions.push_back(n);
                 count =0;
             }
             count = count>=20 ? 0 : ++count;
@@ -1623,6 +1955,7 @@ int main (int argc, char *argv[])
     {
         //gogogo!
         ros::spinOnce();
+        node.checkModel();
         node.Publish();
         node.automatedSynthTouch();
         rate.sleep();
@@ -0,0 +1,33 @@
+#ifndef GP_REGRESSION_TESTS_SPHERE_DATA_HPP_
+#define GP_REGRESSION_TESTS_SPHERE_DATA_HPP_
+
+#include <cmath>
+#include <memory>
+
+#include <gp_regression/gp_regressor.hpp>
+#include <random_generation.hpp>
+
+/**
+ * @brief Object points on a sphere of radius 0.5 (label 0) and external
+ * points on a sphere of radius 2 (label 1), as the node does, all with noise
+ * sigma2.
+ */
+inline gp_regression::Data::Ptr generateData(const std::size_t n_obj, const std::size_t n_ext,
+                const double sigma2 = 1e-1)
+{
+        gp_regression::Data::Ptr data = std::make_shared<gp_regression::Data>();
+        for (std::size_t i = 0; i < n_obj + n_ext; ++i)
+        {
+                const double rho = i < n_obj ? 0.5 : 2.0;
+                const double th = getRandIn(0.0, 2*M_PI);
+                const double ph = std::acos(getRandIn(-1.0, 1.0, true));
+                data->coord_x.push_back(rho*std::sin(ph)*std::cos(th));
+                data->coord_y.push_back(rho*std::sin(ph)*std::sin(th));
+                data->coord_z.push_back(rho*std::cos(ph));
+                data->label.push_back(i < n_obj ? 0.0 : 1.0);
+                data->sigma2.push_back(sigma2);
+        }
+        return data;
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <Eigen/Dense>
+
+#include <atlas/atlas_collision.hpp>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+// a child, its parent and the parent sample it was projected from
+struct Expansion
+{
+        std::size_t child, parent;
+        Eigen::Vector3d sample;
+};
+
+int main()
+{
+        Data::Ptr data = generateData(300, 40, 1e-2);
+        ThinPlateRegressor::Ptr reg = std::make_shared<ThinPlateRegressor>();
+        reg->setCovFunction(std::make_shared<ThinPlate>(2.5));
+        Model::Ptr gp;
+        reg->create<false>(data, gp);
+        gp_atlas_rrt::AtlasCollision atlas(gp, reg);
+
+        // workers expand the nodes they take from a shared frontier, as the
+        // parallel explorer does
+        const std::size_t workers = 4, max_nodes = 80;
+        std::vector<std::size_t> frontier(1, atlas.createNode(Eigen::Vector3d(0.0, 0.0, 0.5)));
+        std::vector<Expansion> expansions;
+        std::size_t busy = 0, rejected = 0;
+        std::mutex mtx;
+        auto work = [&]()
+        {
+                while (true)
+                {
+                        std::size_t parent;
+                        {
+                                std::unique_lock<std::mutex> lock(mtx);
+                                if (atlas.countNodes() >= max_nodes || (frontier.empty() && busy == 0))
+                                        return;
+                                if (frontier.empty())
+                                {
+                                        lock.unlock();
+                                        std::this_thread::yield();
+                                        continue;
+                                }
+                                parent = frontier.back();
+                                frontier.pop_back();
+                                ++busy;
+                        }
+                        const Eigen::Vector3d next = atlas.getNextState(parent);
+                        std::size_t child;
+                        const bool created = !next.isZero() && atlas.createChild(next, parent, child);
+                        gp_atlas_rrt::Chart p = atlas.getNode(parent);
+                        std::lock_guard<std::mutex> lock(mtx);
+                        --busy;
+                        if (p.expandable)
+                                frontier.push_back(parent);
+                        if (created)
+                        {
+                                Expansion e = {child, parent, p.samples.row(p.samp_chosen).transpose()};
+                                expansions.push_back(e);
+                                frontier.push_back(child);
+                        }
+                        else if (!next.isZero())
+                                ++rejected;
+                }
+        };
+        std::vector<std::thread> pool;
+        for (std::size_t i = 0; i < workers; ++i)
+                pool.emplace_back(work);
+        for (auto &t : pool)
+                t.join();
+
+        // every node is stored once under its own id, every child has a parent
+        const std::size_t n = atlas.countNodes();
+        bool ok = n >= 20 && expansions.size() == n - 1;
+        for (std::size_t i = 0; i < n; ++i)
+                ok &= atlas.getNode(i).getId() == i;
+
+        // when a child was committed its sample was free of all the charts but
+        // its parent, as in a serial expansion
+        int violations = 0;
+        for (const auto &e : expansions)
+                for (std::size_t j = 0; j < e.child; ++j)
+                {
+                        const gp_atlas_rrt::Chart c = atlas.getNode(j);
+                        violations += j != e.parent && (e.sample - c.getCenter()).norm() <= c.getRadius();
+                }
+        std::cout << "nodes " << n << ", rejected " << rejected << ", violations " << violations << std::endl;
+        ok &= violations == 0;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
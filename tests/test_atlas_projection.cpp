@@ -0,0 +1,121 @@
+#include <iostream>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <atlas/atlas_collision.hpp>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+// project() is protected, the atlases call it on their disc samples
+class ProjectingAtlas : public gp_atlas_rrt::AtlasCollision
+{
+public:
+        ProjectingAtlas(const Model::ConstPtr &gp, const ThinPlateRegressor::ConstPtr &reg) :
+                AtlasCollision(gp, reg), fail(false)
+        {}
+        // with fail set no projection converges
+        bool project(const Eigen::Vector3d &in, Eigen::Vector3d &out, const Eigen::Vector3d &normal,
+                     const double f_tol = 1e-4, const double x_tol = 1e-9, const unsigned int max_iter = 50,
+                     const std::function<bool()> &cancelled = std::function<bool()>()) override
+        {
+                if (fail){
+                        out = in;
+                        return false;
+                }
+                return AtlasCollision::project(in, out, normal, f_tol, x_tol, max_iter, cancelled);
+        }
+        bool fail;
+};
+
+double meanAt(const ThinPlateRegressor::Ptr &reg, const Model::Ptr &gp, const Eigen::Vector3d &x)
+{
+        Data::Ptr q = std::make_shared<Data>();
+        q->coord_x.push_back(x(0));
+        q->coord_y.push_back(x(1));
+        q->coord_z.push_back(x(2));
+        std::vector<double> f;
+        reg->evaluate(gp, q, f);
+        return f[0];
+}
+
+int main()
+{
+        Data::Ptr data = generateData(300, 40, 1e-2);
+        ThinPlateRegressor::Ptr reg = std::make_shared<ThinPlateRegressor>();
+        reg->setCovFunction(std::make_shared<ThinPlate>(2.5));
+        Model::Ptr gp;
+        reg->create<false>(data, gp);
+        ProjectingAtlas atlas(gp, reg);
+
+        // off surface points, with the gradient at their radial direction
+        const int n = 100;
+        int converged = 0;
+        double f_max = 0.0, r_err = 0.0;
+        for (int i = 0; i < n; ++i)
+        {
+                Eigen::Vector3d dir = Eigen::Vector3d::Random().normalized();
+                const Eigen::Vector3d in = getRandIn(0.3, 0.8)*dir;
+                Eigen::Vector3d out;
+                converged += atlas.project(in, out, dir);
+
+                Data::Ptr q = std::make_shared<Data>();
+                q->coord_x.push_back(out(0));
+                q->coord_y.push_back(out(1));
+                q->coord_z.push_back(out(2));
+                std::vector<double> f;
+                reg->evaluate(gp, q, f);
+                f_max = std::max(f_max, std::abs(f[0]));
+                r_err = std::max(r_err, std::abs(out.norm() - 0.5));
+        }
+        std::cout << "converged " << converged << "/" << n << ", max |f| " << f_max
+                  << ", max radius error " << r_err << std::endl;
+        bool ok = converged == n && f_max < 1e-4 && r_err < 0.05;
+
+        // a cancelled projection stops where it is
+        Eigen::Vector3d out;
+        const Eigen::Vector3d off(0.0, 0.0, 0.7);
+        ok &= !atlas.project(off, out, off, 1e-4, 1e-9, 50, [](){ return true; }) && out == off;
+
+        // with several candidates the next state is the projection of the
+        // best ranked one which converges
+        atlas.setSpeculativeCandidates(4);
+        std::size_t id = atlas.createNode(Eigen::Vector3d(0.0, 0.0, 0.5));
+        int on_surface = 0, steps = 0;
+        for (; steps < 10; ++steps)
+        {
+                const Eigen::Vector3d next = atlas.getNextState(id);
+                if (next.isZero())
+                        break;
+                const gp_atlas_rrt::Chart c = atlas.getNode(id);
+                ok &= c.samp_chosen >= 0;
+                Data::Ptr q = std::make_shared<Data>();
+                q->coord_x.push_back(next(0));
+                q->coord_y.push_back(next(1));
+                q->coord_z.push_back(next(2));
+                std::vector<double> f;
+                reg->evaluate(gp, q, f);
+                on_surface += std::abs(f[0]) < 1e-4;
+                id = atlas.createNode(next);
+        }
+        std::cout << "speculative steps on surface " << on_surface << "/" << steps << std::endl;
+        ok &= steps == 10 && on_surface == steps;
+
+        // when no candidate reaches the surface nothing is charted off it, the
+        // candidates are dropped and the chart is expanded from others later
+        const gp_atlas_rrt::Chart &last = atlas.getNode(id);
+        const std::size_t nodes = atlas.countNodes();
+        atlas.fail = true;
+        ok &= atlas.getNextState(id).isZero() && last.expandable;
+        const std::size_t left = last.vars_ids.size();
+        ok &= atlas.getNextState(id).isZero() && last.expandable && last.vars_ids.size() < left;
+        atlas.fail = false;
+        const Eigen::Vector3d next = atlas.getNextState(id);
+        ok &= !next.isZero() && std::abs(meanAt(reg, gp, next)) < 1e-4 && atlas.countNodes() == nodes;
+        std::cout << "after failed projections, " << left - last.vars_ids.size() << " samples dropped" << std::endl;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+
+#include <atlas/atlas_collision.hpp>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+// exposes the collision query on the grid
+class TestAtlas : public gp_atlas_rrt::AtlasCollision
+{
+        public:
+        TestAtlas(const Model::ConstPtr &gp, const ThinPlateRegressor::ConstPtr &reg):
+                AtlasCollision(gp, reg)
+        {}
+        bool collides(const Eigen::Vector3d &pt, const std::size_t self)
+        {
+                std::lock_guard<std::mutex> lock(nodes_mtx);
+                return isInCollision(pt, self);
+        }
+};
+
+double mean(const ThinPlateRegressor::Ptr &reg, const Model::ConstPtr &gp, const Eigen::Vector3d &x)
+{
+        Data::Ptr q = std::make_shared<Data>();
+        q->coord_x.push_back(x(0));
+        q->coord_y.push_back(x(1));
+        q->coord_z.push_back(x(2));
+        EvalOutput out;
+        reg->evaluate<EVAL_MEAN>(gp, q, out);
+        return out.f.at(0);
+}
+
+int main()
+{
+        setRandomSeed(3);
+        Data::Ptr data = generateData(300, 40, 1e-2);
+        ThinPlateRegressor::Ptr reg = std::make_shared<ThinPlateRegressor>();
+        reg->setCovFunction(std::make_shared<ThinPlate>(2.5));
+        Model::Ptr gp;
+        reg->create<false>(data, gp);
+        TestAtlas atlas(gp, reg);
+
+        // chart the sphere serially
+        std::vector<std::size_t> frontier(1, atlas.createNode(Eigen::Vector3d(0.0, 0.0, 0.5)));
+        while (!frontier.empty() && atlas.countNodes() < 60)
+        {
+                const std::size_t parent = frontier.back();
+                const Eigen::Vector3d next = atlas.getNextState(parent);
+                std::size_t child;
+                if (!next.isZero() && atlas.createChild(next, parent, child))
+                        frontier.push_back(child);
+                else if (!atlas.getNode(parent).expandable)
+                        frontier.pop_back();
+        }
+        const std::size_t n = atlas.countNodes();
+        std::vector<gp_atlas_rrt::Chart> before;
+        for (std::size_t i = 0; i < n; ++i)
+                before.push_back(atlas.getNode(i));
+
+        // touches bulging the surface out around the x axis
+        Data::Ptr fresh = std::make_shared<Data>();
+        for (int i = 0; i < 8; ++i)
+        {
+                const double th = 0.15*std::cos(i*M_PI/4), ph = 0.15*std::sin(i*M_PI/4);
+                fresh->coord_x.push_back(0.55*std::cos(th)*std::cos(ph));
+                fresh->coord_y.push_back(0.55*std::sin(th)*std::cos(ph));
+                fresh->coord_z.push_back(0.55*std::sin(ph));
+                fresh->label.push_back(0.0);
+                fresh->sigma2.push_back(1e-2);
+        }
+        Model::Ptr updated = std::make_shared<Model>(*gp);
+        reg->update<false>(fresh, updated);
+
+        const double influence = 0.1, tol = 1e-2;
+        const std::size_t refreshed = atlas.revalidate(updated, fresh, influence, tol);
+        std::cout << "nodes " << n << ", refreshed " << refreshed << std::endl;
+        bool ok = atlas.getGPModel() == updated && atlas.countNodes() == n + refreshed;
+        ok &= refreshed > 0 && refreshed < n;
+
+        // charts are never moved: the ones near the touches are replaced by
+        // new charts on the new surface, the others are kept unless they were
+        // off it
+        std::size_t near = 0, replaced = 0;
+        atlas.setVarianceTolGoal(-1.0);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+                const gp_atlas_rrt::Chart &c = atlas.getNode(i);
+                ok &= c.getId() == i && c.getCenter() == before[i].getCenter() &&
+                        c.getRadius() == before[i].getRadius();
+                bool is_near = false;
+                for (std::size_t j = 0; j < fresh->coord_x.size(); ++j)
+                {
+                        const Eigen::Vector3d p(fresh->coord_x[j], fresh->coord_y[j], fresh->coord_z[j]);
+                        is_near |= (p - before[i].getCenter()).norm() < influence + before[i].getRadius();
+                }
+                near += is_near;
+                if (c.isValid())
+                {
+                        ok &= !is_near && std::abs(mean(reg, updated, c.getCenter())) <= tol;
+                        continue;
+                }
+                ++replaced;
+                ok &= !c.expandable && !atlas.isSolution(i);
+                ok &= c.replaced_by >= static_cast<long>(n) && c.replaced_by < static_cast<long>(n + refreshed);
+                const gp_atlas_rrt::Chart &r = atlas.getNode(c.replaced_by);
+                ok &= r.isValid() && r.getId() == static_cast<std::size_t>(c.replaced_by);
+                ok &= std::abs(mean(reg, updated, r.getCenter())) < 1e-4;
+        }
+        ok &= near > 0 && replaced == refreshed && near <= refreshed;
+
+        // the grid holds the valid charts only
+        std::size_t mismatches = 0;
+        for (int t = 0; t < 5000; ++t)
+        {
+                const Eigen::Vector3d pt = 0.7*Eigen::Vector3d::Random();
+                const std::size_t self = getRandIn(0, static_cast<int>(n + refreshed));
+                bool expected = false;
+                for (std::size_t i = 0; i < n + refreshed; ++i)
+                {
+                        const gp_atlas_rrt::Chart &c = atlas.getNode(i);
+                        if (c.isValid() && i != self && (pt - c.getCenter()).norm() <= c.getRadius())
+                                expected = true;
+                }
+                mismatches += atlas.collides(pt, self) != expected;
+        }
+        std::cout << "near " << near << ", mismatches " << mismatches << std::endl;
+        ok &= mismatches == 0;
+
+        // the same model again changes nothing
+        ok &= atlas.revalidate(updated, Data::Ptr(), influence, tol) == 0 && atlas.countNodes() == n + refreshed;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
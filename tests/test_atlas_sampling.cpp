@@ -0,0 +1,137 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include <atlas/atlas_collision.hpp>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+// sampleOnChart() and rankSamples() are protected, getNextState() uses them
+class SamplingAtlas : public gp_atlas_rrt::AtlasCollision
+{
+public:
+        SamplingAtlas(const Model::ConstPtr &gp, const ThinPlateRegressor::ConstPtr &reg) :
+                AtlasCollision(gp, reg)
+        {}
+        gp_atlas_rrt::Chart &chart(const std::size_t id)
+        {
+                return nodes.at(id);
+        }
+        using AtlasCollision::sampleOnChart;
+        using AtlasCollision::rankSamples;
+};
+
+int main()
+{
+        Data::Ptr data = generateData(300, 40, 1e-2);
+        ThinPlateRegressor::Ptr reg = std::make_shared<ThinPlateRegressor>();
+        reg->setCovFunction(std::make_shared<ThinPlate>(2.5));
+        Model::Ptr gp;
+        reg->create<false>(data, gp);
+        SamplingAtlas atlas(gp, reg);
+        atlas.setDiscSampleFactor(2000);
+        gp_atlas_rrt::Chart &c = atlas.chart(atlas.createNode(Eigen::Vector3d(0.0, 0.0, 0.5)));
+        atlas.sampleOnChart(c);
+
+        // samples on the annulus of the chart, with their own variance
+        const std::size_t n = c.samples.rows();
+        bool ok = n > 16 && c.vars_ids.size() == n && c.vars_ranked == 16;
+        double err = 0.0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+                const Eigen::Vector3d d = c.samples.row(i).transpose() - c.getCenter();
+                err = std::max(err, std::abs(d.dot(c.getNormal())));
+                ok &= d.norm() >= std::sqrt(0.8)*c.getRadius() - 1e-12 && d.norm() <= c.getRadius() + 1e-12;
+        }
+        for (std::size_t i = 0; i < n; i += 37)
+        {
+                Data::Ptr q = std::make_shared<Data>();
+                const std::size_t s = c.vars_ids[i].second;
+                q->coord_x.push_back(c.samples(s, 0));
+                q->coord_y.push_back(c.samples(s, 1));
+                q->coord_z.push_back(c.samples(s, 2));
+                std::vector<double> f, v;
+                reg->evaluate(gp, q, f, v);
+                err = std::max(err, std::abs(v[0] - c.vars_ids[i].first));
+        }
+        std::cout << "samples " << n << ", error " << err << std::endl;
+        ok &= err < 1e-10;
+
+        // the ranked prefix holds the largest variances, more can be ranked later
+        double largest = 0.0;
+        for (std::size_t i = 0; i < n; ++i)
+                largest = std::max(largest, c.vars_ids[i].first);
+        ok &= c.vars_ids[0].first == largest;
+        for (std::size_t i = 1; i < c.vars_ranked; ++i)
+                ok &= c.vars_ids[i - 1].first >= c.vars_ids[i].first;
+        for (std::size_t i = c.vars_ranked; i < n; ++i)
+                ok &= c.vars_ids[c.vars_ranked - 1].first >= c.vars_ids[i].first;
+        atlas.rankSamples(c, n);
+        for (std::size_t i = 1; i < n; ++i)
+                ok &= c.vars_ids[i - 1].first >= c.vars_ids[i].first;
+        ok &= c.vars_ranked == n;
+
+        // nodes are handed out by reference, their samples can be released and
+        // are drawn again on the next expansion
+        ok &= &atlas.getNode(c.getId()) == &c;
+        const Eigen::Vector3d next = atlas.getNextState(c.getId());
+        ok &= !next.isZero() && c.samp_chosen >= 0;
+        atlas.releaseSamples();
+        ok &= c.samples.size() == 0 && c.vars_ids.capacity() == 0 && c.vars_ranked == 0;
+        ok &= c.samp_chosen == -1;
+        // the index chosen among the old samples means nothing for the new
+        // ones, the best of them is free again
+        ok &= !atlas.getNextState(c.getId()).isZero() && c.samples.rows() > 0;
+        ok &= c.samp_chosen == static_cast<int>(c.vars_ids[0].second);
+
+        // quasi random samples leave no wide angular gap on the disc, an
+        // angle sector of 3 times the mean gap holds at least one of them
+        atlas.setQuasiRandomSampling(true);
+        gp_atlas_rrt::Chart &q = atlas.chart(atlas.createNode(Eigen::Vector3d(0.5, 0.0, 0.0)));
+        atlas.sampleOnChart(q);
+        std::vector<double> angles;
+        for (int i = 0; i < q.samples.rows(); ++i)
+        {
+                const Eigen::Vector3d d = q.samples.row(i).transpose() - q.getCenter();
+                angles.push_back(std::atan2(d.dot(q.getTanBasisTwo()), d.dot(q.getTanBasisOne())));
+                ok &= d.norm() >= std::sqrt(0.8)*q.getRadius() - 1e-12 && d.norm() <= q.getRadius() + 1e-12;
+        }
+        std::sort(angles.begin(), angles.end());
+        double gap = angles.front() + 2*M_PI - angles.back();
+        for (std::size_t i = 1; i < angles.size(); ++i)
+                gap = std::max(gap, angles[i] - angles[i - 1]);
+        std::cout << "quasi random samples " << angles.size() << ", widest gap " << gap*angles.size()/(2*M_PI)
+                  << " mean gaps" << std::endl;
+        ok &= angles.size() > 16 && gap < 3*2*M_PI/angles.size();
+
+        // the adaptive search finds the largest variance on its circle with a
+        // few evaluations
+        atlas.setAdaptiveSampling(true);
+        gp_atlas_rrt::Chart &a = atlas.chart(atlas.createNode(Eigen::Vector3d(0.0, 0.5, 0.0)));
+        atlas.sampleOnChart(a);
+        const double rho = std::sqrt(0.9)*a.getRadius();
+        Data::Ptr circle = std::make_shared<Data>();
+        for (int i = 0; i < 3600; ++i)
+        {
+                const double t = 2*M_PI*i/3600;
+                const Eigen::Vector3d p = a.getCenter() + rho*(std::cos(t)*a.getTanBasisOne() + std::sin(t)*a.getTanBasisTwo());
+                circle->coord_x.push_back(p(0));
+                circle->coord_y.push_back(p(1));
+                circle->coord_z.push_back(p(2));
+        }
+        std::vector<double> f, v;
+        reg->evaluate(gp, circle, f, v);
+        const double dense = *std::max_element(v.begin(), v.end());
+        std::cout << "adaptive samples " << a.samples.rows() << ", best " << a.vars_ids[0].first
+                  << ", dense best " << dense << std::endl;
+        ok &= a.samples.rows() < 60 && a.vars_ids[0].first > dense - 2e-4;
+        for (int i = 0; i < a.samples.rows(); ++i)
+                ok &= std::abs((a.samples.row(i).transpose() - a.getCenter()).norm() - rho) < 1e-12;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+int main( int argc, char** argv )
+{
+        const std::size_t n = argc > 1 ? std::atoi(argv[1]) : 1500;
+        Data::Ptr data = generateData(n, 30);
+        ThinPlateRegressor reg;
+        reg.setCovFunction(std::make_shared<ThinPlate>(2.0));
+
+        Model::Ptr ref, blk = std::make_shared<Model>();
+        blk->factorization = Factorization::BLOCKED_LDLT;
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        reg.create<false>(data, ref);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        reg.create<false>(data, blk);
+        auto t2 = std::chrono::high_resolution_clock::now();
+
+        std::cout << "n = " << data->label.size() << " workers = " << ThreadPool::shared().size() << std::endl;
+        std::cout << "LDLT:         " << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << " ms" << std::endl;
+        std::cout << "Blocked LDLT: " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms" << std::endl;
+
+        const double err = (ref->alpha - blk->alpha).norm() / ref->alpha.norm();
+        std::cout << "relative alpha difference: " << err << std::endl;
+        bool ok = blk->factorization == Factorization::BLOCKED_LDLT && err < 1e-6;
+
+        // predictive variance goes through the solver too
+        Data::Ptr query = generateData(20, 0);
+        query->label.clear();
+        query->sigma2.clear();
+        std::vector<double> f_ref, v_ref, f_blk, v_blk;
+        reg.evaluate(ref, query, f_ref, v_ref);
+        reg.evaluate(blk, query, f_blk, v_blk);
+        for (std::size_t i = 0; i < v_ref.size(); ++i)
+                if (std::abs(v_ref[i] - v_blk[i]) > 1e-6*(1.0 + std::abs(v_ref[i])) ||
+                    std::abs(f_ref[i] - f_blk[i]) > 1e-6)
+                        ok = false;
+
+        // a non positive definite matrix must trigger the fallback
+        Eigen::MatrixXd A = Eigen::MatrixXd::Random(50, 50);
+        A = (A + A.transpose()).eval();
+        A(0,0) = 0.0;
+        BlockedLDLT bad(8);
+        bad.compute(A);
+        if (bad.info() == Eigen::Success)
+                ok = false;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+
+#include <atlas/chart_grid.hpp>
+#include <random_generation.hpp>
+
+using namespace gp_atlas_rrt;
+
+int main()
+{
+        // balls of the chart radii met by the atlas, around the unit sphere
+        const std::size_t n = 3000;
+        std::vector<Eigen::Vector3d> centers(n);
+        std::vector<double> radii(n);
+        ChartGrid grid(0.2);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+                centers[i] = Eigen::Vector3d::Random().normalized();
+                radii[i] = getRandIn(0.02, 0.35);
+                grid.insert(centers[i], radii[i], i);
+        }
+        bool ok = grid.size() == n;
+
+        // against the linear scan, with and without excluding a chart
+        std::size_t mismatches = 0, hits = 0;
+        for (int t = 0; t < 20000; ++t)
+        {
+                const Eigen::Vector3d pt = 1.2*Eigen::Vector3d::Random();
+                const std::size_t self = t % 2 ? getRandIn(0, n - 1) : n;
+                bool expected = false;
+                for (std::size_t i = 0; i < n; ++i)
+                        if (i != self && (pt - centers[i]).squaredNorm() <= radii[i]*radii[i])
+                                expected = true;
+                hits += expected;
+                mismatches += grid.collides(pt, self) != expected;
+        }
+        // a chart center only collides with the others
+        for (std::size_t i = 0; i < n; i += 10)
+        {
+                bool expected = false;
+                for (std::size_t j = 0; j < n; ++j)
+                        if (j != i && (centers[i] - centers[j]).squaredNorm() <= radii[j]*radii[j])
+                                expected = true;
+                mismatches += grid.collides(centers[i], i) != expected;
+        }
+        std::cout << "hits " << hits << ", mismatches " << mismatches << std::endl;
+        ok &= mismatches == 0 && hits > 0;
+
+        // erasing every other ball leaves the rest as they were
+        for (std::size_t i = 0; i < n; i += 2)
+                grid.erase(centers[i], radii[i], i);
+        ok &= grid.size() == n/2;
+        std::size_t erase_mismatches = 0;
+        for (int t = 0; t < 20000; ++t)
+        {
+                const Eigen::Vector3d pt = 1.2*Eigen::Vector3d::Random();
+                bool expected = false;
+                for (std::size_t i = 1; i < n; i += 2)
+                        if ((pt - centers[i]).squaredNorm() <= radii[i]*radii[i])
+                                expected = true;
+                erase_mismatches += grid.collides(pt, n) != expected;
+        }
+        std::cout << "after erase, mismatches " << erase_mismatches << std::endl;
+        ok &= erase_mismatches == 0;
+
+        // a negative radius (large variance) is a ball of radius |r|, as the
+        // squared radius test of the linear scan has it
+        const Eigen::Vector3d far(3.0, 0.0, 0.0);
+        grid.insert(far, -0.3, n);
+        bool negative = grid.size() == n/2 + 1;
+        negative &= grid.collides(far + Eigen::Vector3d(0.0, 0.25, 0.1), n + 1);
+        negative &= grid.collides(far - Eigen::Vector3d(0.29, 0.0, 0.0), n + 1);
+        negative &= !grid.collides(far + Eigen::Vector3d(0.0, 0.0, 0.31), n + 1);
+        negative &= !grid.collides(far, n);
+        grid.erase(far, -0.3, n);
+        negative &= grid.size() == n/2 && !grid.collides(far, n + 1);
+        std::cout << "negative radius " << (negative ? "ok" : "wrong") << std::endl;
+        ok &= negative;
+
+        grid.clear();
+        ok &= grid.size() == 0 && !grid.collides(centers[0], n);
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+bool sameOutput(const EvalOutput &a, const EvalOutput &b)
+{
+        return a.f == b.f && a.v == b.v && a.N == b.N && a.Tx == b.Tx && a.Ty == b.Ty;
+}
+
+// many threads evaluate the same regressor and model at once, with different
+// requests, and every result must be bitwise identical to the serial one
+int main( int argc, char** argv )
+{
+        const std::size_t n_threads = argc > 1 ? std::atoi(argv[1]) : 8;
+        const std::size_t rounds = argc > 2 ? std::atoi(argv[2]) : 50;
+
+        Data::Ptr data = generateData(300, 30);
+        ThinPlateRegressor::Ptr reg = std::make_shared<ThinPlateRegressor>();
+        reg->setCovFunction(std::make_shared<ThinPlate>(2.0));
+        Model::Ptr gp;
+        reg->create<false>(data, gp);
+
+        // from here on, only const access
+        ThinPlateRegressor::ConstPtr reader = reg;
+        Model::ConstPtr snapshot = gp;
+
+        // queries are generated upfront, the random engine is not reentrant
+        const EvalRequest requests[] = { EvalRequest(true),
+                                         EvalRequest(true, false, true),
+                                         EvalRequest(false, true),
+                                         EvalRequest(true, true, true, true) };
+        const std::size_t n_req = sizeof(requests)/sizeof(requests[0]);
+        std::vector<Data::Ptr> queries;
+        std::vector<EvalOutput> expected;
+        for (std::size_t i = 0; i < n_threads; ++i)
+        {
+                Data::Ptr q = generateData(40, 0);
+                q->label.clear();
+                q->sigma2.clear();
+                queries.push_back(q);
+                expected.push_back(EvalOutput());
+                reader->evaluate(snapshot, q, requests[i % n_req], expected.back());
+        }
+
+        std::atomic<std::size_t> mismatches(0), failures(0);
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < n_threads; ++i)
+        {
+                threads.push_back(std::thread([&, i]()
+                {
+                        for (std::size_t r = 0; r < rounds; ++r)
+                        {
+                                try
+                                {
+                                        EvalOutput out;
+                                        reader->evaluate(snapshot, queries[i], requests[i % n_req], out);
+                                        if (!sameOutput(out, expected[i]))
+                                                ++mismatches;
+                                        // the legacy overloads go through the same path
+                                        std::vector<double> f, v;
+                                        reader->evaluate(snapshot, queries[i], f, v);
+                                        if (f.size() != queries[i]->coord_x.size())
+                                                ++mismatches;
+                                }
+                                catch (const std::exception &e)
+                                {
+                                        std::cout << "thread " << i << ": " << e.what() << std::endl;
+                                        ++failures;
+                                }
+                        }
+                }));
+        }
+        for (auto &t : threads)
+                t.join();
+
+        std::cout << n_threads << " threads x " << rounds << " rounds, mismatches: " << mismatches
+                  << ", failures: " << failures << std::endl;
+        const bool ok = mismatches == 0 && failures == 0;
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
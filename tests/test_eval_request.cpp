@@ -0,0 +1,107 @@
+#include <iostream>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+double maxDifference(const std::vector<double> &a, const std::vector<double> &b)
+{
+        double err = a.size() == b.size() ? 0.0 : 1e10;
+        for (std::size_t i = 0; i < a.size() && i < b.size(); ++i)
+                err = std::max(err, std::abs(a[i] - b[i]));
+        return err;
+}
+
+double maxDifference(const Eigen::MatrixXd &a, const Eigen::MatrixXd &b)
+{
+        if (a.rows() != b.rows() || a.cols() != b.cols())
+                return 1e10;
+        return a.size() == 0 ? 0.0 : (a - b).cwiseAbs().maxCoeff();
+}
+
+int main()
+{
+        Data::Ptr data = generateData(300, 40);
+        Data::Ptr query = generateData(50, 0);
+        query->label.clear();
+        query->sigma2.clear();
+        const std::size_t q = query->coord_x.size();
+
+        ThinPlateRegressor reg;
+        std::shared_ptr<ThinPlate> kernel = std::make_shared<ThinPlate>(2.0);
+        reg.setCovFunction(kernel);
+        Model::Ptr gp;
+        reg.create<false>(data, gp);
+
+        // what the legacy overloads give
+        std::vector<double> f, v;
+        Eigen::MatrixXd N, Tx, Ty;
+        reg.evaluate(gp, query, f, v, N, Tx, Ty);
+        std::vector<double> f_only, fv_f, fv_v;
+        reg.evaluate(gp, query, f_only);
+        reg.evaluate(gp, query, fv_f, fv_v);
+        double err = maxDifference(f, f_only) + maxDifference(f, fv_f) + maxDifference(v, fv_v);
+
+        // there is no legacy hessian, sum it straight from the weights
+        std::vector<Eigen::Matrix3d> H(q, Eigen::Matrix3d::Zero());
+        for (std::size_t i = 0; i < q; ++i)
+        {
+                const Eigen::Vector3d x(query->coord_x[i], query->coord_y[i], query->coord_z[i]);
+                for (int j = 0; j < gp->P.rows(); ++j)
+                {
+                        const Eigen::Vector3d d = x - gp->P.row(j).transpose();
+                        const double r = d.norm();
+                        H[i] += gp->alpha(j)*(kernel->computediff(r)*Eigen::Matrix3d::Identity() +
+                                        kernel->computediffdiff(r)*d*d.transpose());
+                }
+        }
+
+        // every request fills exactly what it asks for, with the same values
+        bool ok = true;
+        std::size_t wrong_outputs = 0;
+        for (unsigned mask = 0; mask < 2*EVAL_HESSIAN; ++mask)
+        {
+                const EvalRequest req(mask & EVAL_MEAN, mask & EVAL_GRAD, mask & EVAL_VAR,
+                                mask & EVAL_TANGENTS, mask & EVAL_HESSIAN);
+                ok &= req.mask() == mask;
+                EvalOutput out;
+                reg.evaluate(gp, query, req, out);
+                const bool grad = mask & (EVAL_GRAD | EVAL_TANGENTS);
+                const bool tangents = mask & EVAL_TANGENTS;
+                const bool hessian = mask & EVAL_HESSIAN;
+                if (out.f.empty() == bool(mask & EVAL_MEAN) || out.v.empty() == bool(mask & EVAL_VAR) ||
+                    (out.N.size() == 0) == grad || (out.Tx.size() == 0) == tangents ||
+                    (out.Ty.size() == 0) == tangents || out.H.empty() == hessian)
+                {
+                        std::cout << "mask " << mask << " fills the wrong outputs" << std::endl;
+                        ++wrong_outputs;
+                        continue;
+                }
+                if (mask & EVAL_MEAN)
+                        err = std::max(err, maxDifference(out.f, f));
+                if (mask & EVAL_VAR)
+                        err = std::max(err, maxDifference(out.v, v));
+                if (grad)
+                        err = std::max(err, maxDifference(out.N, N));
+                if (tangents)
+                        err = std::max(err, maxDifference(out.Tx, Tx) + maxDifference(out.Ty, Ty));
+                if (hessian)
+                        for (std::size_t i = 0; i < q; ++i)
+                                err = std::max(err, (out.H[i] - H[i]).cwiseAbs().maxCoeff() / (1.0 + H[i].norm()));
+        }
+        std::cout << "masks with wrong outputs " << wrong_outputs << ", max difference " << err << std::endl;
+        ok &= wrong_outputs == 0 && err < 1e-8;
+
+        // the default request is the mean alone
+        EvalOutput out;
+        reg.evaluate(gp, query, EvalRequest(), out);
+        ok &= maxDifference(out.f, f) < 1e-12 && out.v.empty() && out.N.size() == 0;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+
+#include <atlas/exp_multibranch.hpp>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+void runToEnd(gp_atlas_rrt::ExplorerMultiBranch &explorer)
+{
+        explorer.startExploration();
+        while (!explorer.hasSolution())
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        explorer.stopExploration();
+}
+
+// an atlas charted for a goal no node reaches is resumed with a lower goal
+bool checkResume(const Model::Ptr &gp, const ThinPlateRegressor::Ptr &reg, const std::size_t workers)
+{
+        std::shared_ptr<gp_atlas_rrt::AtlasCollision> atlas =
+                std::make_shared<gp_atlas_rrt::AtlasCollision>(gp, reg);
+        atlas->setVarianceTolGoal(10.0);
+        atlas->setVarRadiusFactor(0.3);
+        gp_atlas_rrt::ExplorerMultiBranch explorer(ros::NodeHandle(), "explorer");
+        visualization_msgs::MarkerArrayPtr markers(new visualization_msgs::MarkerArray);
+        markers->markers.resize(1);
+        explorer.setMarkers(markers, std::make_shared<std::mutex>(), "frame");
+        explorer.setAtlas(atlas);
+        explorer.setMaxNodes(40);
+        explorer.setNoSampleMarkers(true);
+        explorer.setWorkers(workers);
+        explorer.setStart(Eigen::Vector3d(0.0, 0.0, 0.5));
+        runToEnd(explorer);
+        const std::size_t n = atlas->countNodes();
+        bool ok = n > 1 && explorer.getSolution().empty();
+
+        std::size_t best = 0;
+        for (std::size_t i = 1; i < n; ++i)
+                if (atlas->getNode(i).getVariance() > atlas->getNode(best).getVariance())
+                        best = i;
+        const double best_v = atlas->getNode(best).getVariance();
+
+        // just below the largest variance only that node is a solution, and
+        // it is found among the charted ones, without expanding
+        atlas->setVarianceTolGoal(best_v - 1e-9);
+        runToEnd(explorer);
+        const std::vector<std::size_t> solution = explorer.getSolution();
+        ok &= atlas->countNodes() == n && !solution.empty();
+        ok &= solution.front() == best && solution.back() == 0;
+
+        // a lower goal still picks the largest variance among those above it
+        atlas->setVarianceTolGoal(0.5*best_v);
+        runToEnd(explorer);
+        ok &= atlas->countNodes() == n && !explorer.getSolution().empty() && explorer.getSolution().front() == best;
+
+        // above every chart the tree is expanded again
+        atlas->setVarianceTolGoal(10.0);
+        runToEnd(explorer);
+        ok &= atlas->countNodes() > n && explorer.getSolution().empty();
+        std::cout << "workers " << workers << ": charted " << n << ", best " << best
+                  << " variance " << best_v << ", path length " << solution.size() << std::endl;
+        return ok;
+}
+
+// after revalidate() the tree goes through the charts replacing the old ones
+bool checkRevalidated(const Model::Ptr &gp, const ThinPlateRegressor::Ptr &reg)
+{
+        std::shared_ptr<gp_atlas_rrt::AtlasCollision> atlas =
+                std::make_shared<gp_atlas_rrt::AtlasCollision>(gp, reg);
+        atlas->setVarianceTolGoal(10.0);
+        atlas->setVarRadiusFactor(0.3);
+        gp_atlas_rrt::ExplorerMultiBranch explorer(ros::NodeHandle(), "explorer");
+        visualization_msgs::MarkerArrayPtr markers(new visualization_msgs::MarkerArray);
+        explorer.setMarkers(markers, std::make_shared<std::mutex>(), "frame");
+        explorer.setAtlas(atlas);
+        explorer.setMaxNodes(40);
+        explorer.setNoSampleMarkers(true);
+        explorer.setStart(Eigen::Vector3d(0.0, 0.0, 0.5));
+        runToEnd(explorer);
+        const std::size_t n = atlas->countNodes();
+
+        // touches around the root move the charts near it
+        Data::Ptr fresh = std::make_shared<Data>();
+        for (int i = 0; i < 8; ++i)
+        {
+                const double th = 0.2*std::cos(i*M_PI/4), ph = 0.2*std::sin(i*M_PI/4);
+                fresh->coord_x.push_back(0.55*std::sin(th)*std::cos(ph));
+                fresh->coord_y.push_back(0.55*std::sin(ph));
+                fresh->coord_z.push_back(0.55*std::cos(th)*std::cos(ph));
+                fresh->label.push_back(0.0);
+                fresh->sigma2.push_back(1e-2);
+        }
+        Model::Ptr updated = std::make_shared<Model>(*gp);
+        reg->update<false>(fresh, updated);
+        const std::size_t refreshed = atlas->revalidate(updated, fresh, 0.1, 1e-2);
+        bool ok = refreshed > 0 && !atlas->getNode(0).isValid();
+
+        // every valid chart is a solution: paths only cross valid charts and
+        // end at the replacement of the root
+        std::size_t root = 0;
+        while (!atlas->getNode(root).isValid())
+                root = atlas->getNode(root).replaced_by;
+        atlas->setVarianceTolGoal(-1.0);
+        runToEnd(explorer);
+        const std::vector<std::size_t> solution = explorer.getSolution();
+        ok &= atlas->countNodes() == n + refreshed && !solution.empty() && solution.back() == root;
+        for (const std::size_t id : solution)
+                ok &= atlas->getNode(id).isValid();
+
+        // the markers are the ones of the valid charts, without duplicates
+        std::size_t node_markers = 0;
+        for (const visualization_msgs::Marker &m : markers->markers)
+                node_markers += m.ns == "Atlas Nodes";
+        ok &= node_markers == n;
+        std::cout << "charted " << n << ", replaced " << refreshed << ", root now " << root
+                  << ", path length " << solution.size() << ", node markers " << node_markers << std::endl;
+        return ok;
+}
+
+int main(int argc, char **argv)
+{
+        ros::init(argc, argv, "test_explorer_resume",
+                  ros::init_options::AnonymousName | ros::init_options::NoRosout);
+        setRandomSeed(5);
+        Data::Ptr data = generateData(300, 40, 1e-2);
+        ThinPlateRegressor::Ptr reg = std::make_shared<ThinPlateRegressor>();
+        reg->setCovFunction(std::make_shared<ThinPlate>(2.5));
+        Model::Ptr gp;
+        reg->create<false>(data, gp);
+
+        bool ok = checkResume(gp, reg, 1);
+        ok &= checkResume(gp, reg, 3);
+        ok &= checkRevalidated(gp, reg);
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+BasicData<3>::Ptr toFixed(const Data::ConstPtr &data)
+{
+        BasicData<3>::Ptr fixed = std::make_shared<BasicData<3>>();
+        for (std::size_t i = 0; i < data->coord_x.size(); ++i)
+                fixed->push_back(Eigen::Vector3d(data->coord_x[i], data->coord_y[i], data->coord_z[i]));
+        fixed->label = data->label;
+        fixed->sigma2 = data->sigma2;
+        return fixed;
+}
+
+int main( int argc, char** argv )
+{
+        bool ok = true;
+        const std::size_t n = argc > 1 ? std::atoi(argv[1]) : 500;
+
+        // same model in 3D, through the dynamic and the fixed regressor
+        Data::Ptr data = generateData(n, 30);
+        Data::Ptr query = generateData(2000, 0);
+        query->label.clear();
+        query->sigma2.clear();
+
+        GPRegressor<ThinPlate> dyn;
+        GPRegressor<ThinPlate, 3> fix;
+        dyn.setCovFunction(std::make_shared<ThinPlate>(2.0));
+        fix.setCovFunction(std::make_shared<ThinPlate>(2.0));
+        Model::Ptr gp_dyn;
+        BasicModel<3>::Ptr gp_fix;
+        dyn.create<false>(data, gp_dyn);
+        fix.create<false>(toFixed(data), gp_fix);
+
+        EvalOutput out_dyn, out_fix;
+        auto t0 = std::chrono::high_resolution_clock::now();
+        dyn.evaluate<EVAL_MEAN | EVAL_GRAD | EVAL_VAR>(gp_dyn, query, out_dyn);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        fix.evaluate<EVAL_MEAN | EVAL_GRAD | EVAL_VAR>(gp_fix, toFixed(query), out_fix);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        std::cout << "dynamic: " << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << " ms, "
+                  << "fixed: " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms" << std::endl;
+        double err(0.0);
+        for (std::size_t i = 0; i < out_dyn.f.size(); ++i)
+                err = std::max(err, std::abs(out_dyn.f[i] - out_fix.f[i]) + std::abs(out_dyn.v[i] - out_fix.v[i]));
+        err = std::max(err, (out_dyn.N - out_fix.N).cwiseAbs().maxCoeff());
+        std::cout << "3D fixed vs dynamic: " << err << std::endl;
+        ok &= err < 1e-8;
+
+        // a 2D contour: the unit circle is the zero level set
+        GPRegressor<ThinPlate, 2> contour;
+        contour.setCovFunction(std::make_shared<ThinPlate>(4.0));
+        BasicData<2>::Ptr circle = std::make_shared<BasicData<2>>();
+        for (int i = 0; i < 40; ++i)
+        {
+                const double th = 2*M_PI*i/40;
+                circle->push_back(Eigen::Vector2d(std::cos(th), std::sin(th)), 0.0, 1e-4);
+                circle->push_back(Eigen::Vector2d(2*std::cos(th), 2*std::sin(th)), 1.0, 1e-4);
+        }
+        BasicModel<2>::Ptr gp_circle;
+        contour.create<false>(circle, gp_circle);
+        BasicData<2>::Ptr probe = std::make_shared<BasicData<2>>();
+        for (int i = 0; i < 40; ++i)
+                probe->push_back(Eigen::Vector2d(std::cos(2*M_PI*(i + 0.5)/40), std::sin(2*M_PI*(i + 0.5)/40)));
+        EvalOutput out_circle;
+        contour.evaluate<EVAL_MEAN | EVAL_GRAD>(gp_circle, probe, out_circle);
+        const BasicData<2>::Points probe_points = probe->points();
+        double off(0.0), outward(1.0);
+        for (int i = 0; i < 40; ++i)
+        {
+                off = std::max(off, std::abs(out_circle.f[i]));
+                outward = std::min(outward, out_circle.N.row(i).normalized().dot(probe_points.row(i)));
+        }
+        std::cout << "2D contour: |f| " << off << ", normal alignment " << outward << std::endl;
+        ok &= off < 0.05 && outward > 0.9;
+        // tangents and hessians are three dimensional
+        bool thrown = false;
+        try
+        {
+                contour.evaluate<EVAL_HESSIAN>(gp_circle, probe, out_circle);
+        }
+        catch (const GPRegressionException &)
+        {
+                thrown = true;
+        }
+        ok &= thrown;
+
+        // 6D, updating the model gives the same as creating it at once
+        GPRegressor<ThinPlate, 6> pose;
+        pose.setCovFunction(std::make_shared<ThinPlate>(6.0));
+        typedef BasicData<6>::Point Point6;
+        BasicData<6>::Ptr first = std::make_shared<BasicData<6>>();
+        BasicData<6>::Ptr second = std::make_shared<BasicData<6>>();
+        BasicData<6>::Ptr all = std::make_shared<BasicData<6>>();
+        for (int i = 0; i < 120; ++i)
+        {
+                const Point6 p = Point6::Random();
+                const double l = p.squaredNorm() - 1.0;
+                (i < 100 ? first : second)->push_back(p, l, 1e-2);
+                all->push_back(p, l, 1e-2);
+        }
+        BasicModel<6>::Ptr gp_up, gp_all;
+        pose.create<false>(first, gp_up);
+        pose.update<false>(second, gp_up);
+        pose.create<false>(all, gp_all);
+        const double err6 = (gp_up->alpha - gp_all->alpha).norm() / gp_all->alpha.norm();
+        std::cout << "6D update vs create: " << err6 << std::endl;
+        ok &= err6 < 1e-8;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -113,7 +113,7 @@ int main( int argc, char** argv )
         double R = 0.4;
         // double sigma = 0.02;
         // double length = 0.03;
-        ThinPlate my_kernel(R);
+        std::shared_ptr<ThinPlate> my_kernel = std::make_shared<ThinPlate>(R);
         ThinPlateRegressor regresor;
         // Gaussian my_kernel(sigma, length);
         // GaussianRegressor regresor;
@@ -0,0 +1,157 @@
+#include <iostream>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+// the gradient of |x|^2, i.e. the outward normal of the sphere, at some of
+// its points
+GradientData::Ptr generateGradients(const std::size_t n)
+{
+        Data::Ptr points = generateData(n, 0, 1e-4);
+        GradientData::Ptr gradients = std::make_shared<GradientData>();
+        gradients->coord_x = points->coord_x;
+        gradients->coord_y = points->coord_y;
+        gradients->coord_z = points->coord_z;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+                gradients->grad_x.push_back(2*points->coord_x[i]);
+                gradients->grad_y.push_back(2*points->coord_y[i]);
+                gradients->grad_z.push_back(2*points->coord_z[i]);
+                gradients->sigma2.push_back(1e-6);
+        }
+        return gradients;
+}
+
+int main()
+{
+        Data::Ptr data = generateData(40, 20, 1e-4);
+        GradientData::Ptr gradients = generateGradients(15);
+        GradientData::Ptr more = generateGradients(5);
+        Data::Ptr query = generateData(30, 0, 1e-4);
+        query->label.clear();
+        query->sigma2.clear();
+
+        ThinPlateRegressor reg;
+        reg.setCovFunction(std::make_shared<ThinPlate>(2.5));
+
+        Model::Ptr plain, gp;
+        reg.create<false>(data, plain);
+        reg.create<true>(data, gradients, gp);
+
+        // the mean reproduces the observed gradients, up to the noise:
+        // m'(g_j) = y'_j - sigma2_j*beta_j
+        Data::Ptr at_gradients = std::make_shared<Data>();
+        at_gradients->coord_x = gradients->coord_x;
+        at_gradients->coord_y = gradients->coord_y;
+        at_gradients->coord_z = gradients->coord_z;
+        EvalOutput out;
+        reg.evaluate<EVAL_MEAN | EVAL_GRAD>(gp, at_gradients, out);
+        double err = 0.0;
+        for (std::size_t i = 0; i < gradients->grad_x.size(); ++i)
+        {
+                const Eigen::Vector3d g(gradients->grad_x[i], gradients->grad_y[i], gradients->grad_z[i]);
+                const Eigen::Vector3d residual = gradients->sigma2[i]*gp->beta.row(i).transpose();
+                err = std::max(err, (out.N.row(i).transpose() - g + residual).norm());
+        }
+        std::cout << "observed gradients " << err << std::endl;
+        bool ok = err < 1e-6;
+
+        // the gradient is the derivative of the mean
+        const double h = 1e-5;
+        EvalOutput central;
+        reg.evaluate<EVAL_MEAN | EVAL_GRAD>(gp, query, central);
+        err = 0.0;
+        for (int b = 0; b < 3; ++b)
+        {
+                Data::Ptr plus = std::make_shared<Data>(*query), minus = std::make_shared<Data>(*query);
+                std::vector<double> &cp = b == 0 ? plus->coord_x : b == 1 ? plus->coord_y : plus->coord_z;
+                std::vector<double> &cm = b == 0 ? minus->coord_x : b == 1 ? minus->coord_y : minus->coord_z;
+                for (std::size_t i = 0; i < cp.size(); ++i)
+                {
+                        cp[i] += h;
+                        cm[i] -= h;
+                }
+                std::vector<double> fp, fm;
+                reg.evaluate(gp, plus, fp);
+                reg.evaluate(gp, minus, fm);
+                for (std::size_t i = 0; i < fp.size(); ++i)
+                        err = std::max(err, std::abs((fp[i] - fm[i])/(2*h) - central.N(i, b)));
+        }
+        std::cout << "finite difference gradient " << err << std::endl;
+        ok &= err < 1e-5;
+
+        // the variance against the cross covariance by finite differences
+        const ThinPlate k(2.5);
+        Eigen::MatrixXd Q(query->coord_x.size(), 3);
+        for (int i = 0; i < Q.rows(); ++i)
+                Q.row(i) << query->coord_x[i], query->coord_y[i], query->coord_z[i];
+        const int n = gp->P.rows(), m = gp->G.rows();
+        Eigen::MatrixXd Ks(Q.rows(), n + 3*m);
+        for (int i = 0; i < Q.rows(); ++i)
+        {
+                for (int j = 0; j < n; ++j)
+                        Ks(i, j) = k.compute((Q.row(i) - gp->P.row(j)).norm());
+                for (int j = 0; j < m; ++j)
+                        for (int b = 0; b < 3; ++b)
+                        {
+                                const Eigen::RowVector3d e = h*Eigen::RowVector3d::Unit(b);
+                                Ks(i, n + 3*j + b) = (k.compute((Q.row(i) - gp->G.row(j) - e).norm()) -
+                                                      k.compute((Q.row(i) - gp->G.row(j) + e).norm()))/(2*h);
+                        }
+        }
+        const Eigen::MatrixXd V = gp->Kpp.ldlt().solve(Ks.transpose());
+        std::vector<double> f, v, v_plain;
+        reg.evaluate(gp, query, f, v);
+        reg.evaluate(plain, query, f, v_plain);
+        err = 0.0;
+        int smaller = 0;
+        for (int i = 0; i < Q.rows(); ++i)
+        {
+                err = std::max(err, std::abs(k.compute(0.0) - Ks.row(i).dot(V.col(i)) - v[i]));
+                smaller += v[i] < v_plain[i];
+        }
+        std::cout << "variance " << err << ", lower at " << smaller << "/" << Q.rows() << std::endl;
+        ok &= err < 1e-4 && smaller == Q.rows();
+
+        // more gradients, as a create with all of them
+        reg.update<true>(Data::ConstPtr(), more, gp);
+        GradientData::Ptr all = std::make_shared<GradientData>(*gradients);
+        all->coord_x.insert(all->coord_x.end(), more->coord_x.begin(), more->coord_x.end());
+        all->coord_y.insert(all->coord_y.end(), more->coord_y.begin(), more->coord_y.end());
+        all->coord_z.insert(all->coord_z.end(), more->coord_z.begin(), more->coord_z.end());
+        all->grad_x.insert(all->grad_x.end(), more->grad_x.begin(), more->grad_x.end());
+        all->grad_y.insert(all->grad_y.end(), more->grad_y.begin(), more->grad_y.end());
+        all->grad_z.insert(all->grad_z.end(), more->grad_z.begin(), more->grad_z.end());
+        all->sigma2.insert(all->sigma2.end(), more->sigma2.begin(), more->sigma2.end());
+        Model::Ptr reference;
+        reg.create<true>(data, all, reference);
+        EvalOutput out_a, out_b;
+        reg.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(gp, query, out_a);
+        reg.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(reference, query, out_b);
+        err = (out_a.N - out_b.N).cwiseAbs().maxCoeff() + (gp->N - reference->N).cwiseAbs().maxCoeff();
+        for (std::size_t i = 0; i < out_a.f.size(); ++i)
+                err = std::max(err, std::abs(out_a.f[i] - out_b.f[i]) + std::abs(out_a.v[i] - out_b.v[i]));
+        std::cout << "update " << err << std::endl;
+        ok &= err < 1e-8 && gp->last_update.p == 0;
+
+        // no third derivatives of the kernel
+        bool thrown = false;
+        try
+        {
+                reg.evaluate<EVAL_HESSIAN>(gp, query, out);
+        }
+        catch (const GPRegressionException &)
+        {
+                thrown = true;
+        }
+        ok &= thrown;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
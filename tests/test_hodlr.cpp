@@ -0,0 +1,70 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+double maxDifference(const EvalOutput &a, const EvalOutput &b)
+{
+        double err = (a.N - b.N).cwiseAbs().maxCoeff();
+        for (std::size_t i = 0; i < a.f.size(); ++i)
+                err = std::max(err, std::abs(a.f[i] - b.f[i]) + std::abs(a.v[i] - b.v[i]));
+        return err;
+}
+
+int main()
+{
+        Data::Ptr data = generateData(2700, 300);
+        Data::Ptr more = generateData(60, 0);
+        Data::Ptr query = generateData(200, 0);
+        query->label.clear();
+        query->sigma2.clear();
+
+        ThinPlateRegressor reg;
+        reg.setCovFunction(std::make_shared<ThinPlate>(2.0));
+        Model::Ptr dense = std::make_shared<Model>();
+        Model::Ptr compressed = std::make_shared<Model>();
+        compressed->factorization = Factorization::HODLR;
+
+        auto begin = std::chrono::high_resolution_clock::now();
+        reg.create<false>(data, dense);
+        auto middle = std::chrono::high_resolution_clock::now();
+        reg.create<false>(data, compressed);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "create dense " << std::chrono::duration_cast<std::chrono::milliseconds>(middle - begin).count()
+                  << " ms, compressed " << std::chrono::duration_cast<std::chrono::milliseconds>(end - middle).count()
+                  << " ms, rank " << compressed->compressed.maxRank() << ", storage "
+                  << compressed->compressed.storage() / std::pow(data->label.size(), 2) << " of dense" << std::endl;
+        bool ok = compressed->factorization == Factorization::HODLR && compressed->Kpp.size() == 0;
+
+        // the compressed matrix product matches the dense covariance
+        const Eigen::VectorXd x = Eigen::VectorXd::Random(dense->Kpp.rows());
+        const double err_mul = (compressed->compressed.multiply(x) - dense->Kpp*x).norm() / (dense->Kpp*x).norm();
+        std::cout << "product " << err_mul << std::endl;
+        ok &= err_mul < 1e-4;
+
+        EvalOutput out_dense, out_compressed;
+        reg.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(dense, query, out_dense);
+        reg.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(compressed, query, out_compressed);
+        double err = maxDifference(out_dense, out_compressed);
+        std::cout << "create " << err << std::endl;
+        ok &= err < 1e-4;
+
+        // updates rebuild the compression
+        reg.update<false>(more, dense);
+        reg.update<false>(more, compressed);
+        reg.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(dense, query, out_dense);
+        reg.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(compressed, query, out_compressed);
+        err = maxDifference(out_dense, out_compressed);
+        std::cout << "update " << err << std::endl;
+        ok &= err < 1e-4 && compressed->compressed.rows() == dense->Kpp.rows();
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+typedef Sum<ThinPlate, Scaled<Gaussian>> BumpedThinPlate;
+
+// the fused array expressions must match the scalar methods, and these must
+// match finite differences (computediff = k'/r, computediffdiff = computediff'/r)
+template <typename CovType>
+bool checkKernel(const CovType &k, const std::string &name)
+{
+        const double h = 1e-6;
+        Eigen::ArrayXd r = Eigen::ArrayXd::LinSpaced(50, 0.05, 2.0);
+        const Eigen::ArrayXd K = k.computeArray(r);
+        const Eigen::ArrayXd Kd = k.computediffArray(r);
+        const Eigen::ArrayXd Kdd = k.computediffdiffArray(r);
+        double err_array(0.0), err_diff(0.0), err_diffdiff(0.0);
+        for (int i = 0; i < r.size(); ++i)
+        {
+                err_array = std::max(err_array, std::abs(K(i) - k.compute(r(i))) +
+                                std::abs(Kd(i) - k.computediff(r(i))) +
+                                std::abs(Kdd(i) - k.computediffdiff(r(i))));
+                const double fd = (k.compute(r(i) + h) - k.compute(r(i) - h)) / (2*h);
+                err_diff = std::max(err_diff, std::abs(fd/r(i) - Kd(i)) / (1.0 + std::abs(Kd(i))));
+                const double fdd = (k.computediff(r(i) + h) - k.computediff(r(i) - h)) / (2*h);
+                err_diffdiff = std::max(err_diffdiff, std::abs(fdd/r(i) - Kdd(i)) / (1.0 + std::abs(Kdd(i))));
+        }
+        std::cout << name << ": array " << err_array << " diff " << err_diff
+                  << " diffdiff " << err_diffdiff << std::endl;
+        return err_array < 1e-12 && err_diff < 1e-6 && err_diffdiff < 1e-6;
+}
+
+// gradient and hessian of the mean through the regressor, against finite
+// differences of the mean and of the gradient
+template <typename CovType>
+bool checkRegressor(const CovType &k, const std::string &name)
+{
+        Data::Ptr data = generateData(200, 30);
+        GPRegressor<CovType> reg;
+        reg.setCovFunction(std::make_shared<CovType>(k));
+        Model::Ptr gp;
+        reg.template create<false>(data, gp);
+
+        // off the training points, where the Gaussian has its cusps
+        Data::Ptr query = generateData(20, 0);
+        query->label.clear();
+        query->sigma2.clear();
+        for (std::size_t i = 0; i < query->coord_x.size(); ++i)
+        {
+                query->coord_x[i] *= 1.1;
+                query->coord_y[i] *= 1.1;
+                query->coord_z[i] *= 1.1;
+        }
+        EvalOutput out;
+        reg.template evaluate<EVAL_MEAN | EVAL_GRAD | EVAL_HESSIAN>(gp, query, out);
+
+        const double h = 1e-5;
+        double err_grad(0.0), err_hess(0.0);
+        for (std::size_t i = 0; i < query->coord_x.size(); ++i)
+        {
+                // the six points x +- h*e_d
+                Data::Ptr stencil = std::make_shared<Data>();
+                for (int d = 0; d < 3; ++d)
+                        for (const double s : {h, -h})
+                        {
+                                stencil->coord_x.push_back(query->coord_x[i] + (d == 0 ? s : 0.0));
+                                stencil->coord_y.push_back(query->coord_y[i] + (d == 1 ? s : 0.0));
+                                stencil->coord_z.push_back(query->coord_z[i] + (d == 2 ? s : 0.0));
+                        }
+                EvalOutput around;
+                reg.template evaluate<EVAL_MEAN | EVAL_GRAD>(gp, stencil, around);
+                for (int d = 0; d < 3; ++d)
+                {
+                        const double fd = (around.f[2*d] - around.f[2*d + 1]) / (2*h);
+                        err_grad = std::max(err_grad, std::abs(fd - out.N(i, d)) / (1.0 + out.N.row(i).norm()));
+                        const Eigen::Vector3d fdd = (around.N.row(2*d) - around.N.row(2*d + 1)).transpose() / (2*h);
+                        err_hess = std::max(err_hess, (fdd - out.H[i].col(d)).cwiseAbs().maxCoeff() / (1.0 + out.H[i].norm()));
+                }
+        }
+        std::cout << name << " through the regressor: gradient " << err_grad << " hessian " << err_hess << std::endl;
+        return err_grad < 1e-6 && err_hess < 1e-5;
+}
+
+int main()
+{
+        bool ok = true;
+        ok &= checkKernel(Gaussian(1.0, 0.5), "Gaussian");
+        ok &= checkKernel(Laplace(1.0, 0.5), "Laplace");
+        ok &= checkKernel(Product<ThinPlate, Scaled<ThinPlate>>(ThinPlate(2.0), Scaled<ThinPlate>(0.5, ThinPlate(1.5))), "Product");
+        ok &= checkKernel(Sum<ThinPlate, Scaled<ThinPlate>>(ThinPlate(2.0), Scaled<ThinPlate>(-0.3, ThinPlate(3.0))), "Sum");
+        ok &= checkKernel(Product<ThinPlate, Gaussian>(ThinPlate(2.0), Gaussian(1.0, 0.5)), "Product with Gaussian");
+
+        // thin plate and Gaussian follow the same convention once mixed
+        const BumpedThinPlate bumped_kernel(ThinPlate(2.0), Scaled<Gaussian>(0.3, Gaussian(1.0, 0.5)));
+        ok &= checkKernel(bumped_kernel, "Sum with Gaussian");
+        ok &= checkRegressor(ThinPlate(2.0), "ThinPlate");
+        ok &= checkRegressor(bumped_kernel, "Sum with Gaussian");
+
+        // a composed kernel goes through the regressor as any other
+        Data::Ptr data = generateData(200, 30);
+        Data::Ptr query = generateData(20, 0);
+        query->label.clear();
+        query->sigma2.clear();
+
+        GPRegressor<ThinPlate> plain;
+        plain.setCovFunction(std::make_shared<ThinPlate>(2.0));
+        GPRegressor<BumpedThinPlate> bumped;
+        bumped.setCovFunction(std::make_shared<BumpedThinPlate>(ThinPlate(2.0), Scaled<Gaussian>(0.0)));
+        Model::Ptr gp_plain, gp_bumped;
+        plain.create<false>(data, gp_plain);
+        bumped.create<false>(data, gp_bumped);
+        EvalOutput out_plain, out_bumped;
+        plain.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(gp_plain, query, out_plain);
+        bumped.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(gp_bumped, query, out_bumped);
+        double err(0.0);
+        for (std::size_t i = 0; i < out_plain.f.size(); ++i)
+                err = std::max(err, std::abs(out_plain.f[i] - out_bumped.f[i]) + std::abs(out_plain.v[i] - out_bumped.v[i]));
+        err = std::max(err, (out_plain.N - out_bumped.N).cwiseAbs().maxCoeff());
+        std::cout << "zero bump vs plain thin plate: " << err << std::endl;
+        ok &= err < 1e-9;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+#include <iostream>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+// closed form leave-one-out against n actual refits
+bool check(const Factorization factorization)
+{
+        Data::Ptr data = generateData(80, 20);
+        ThinPlateRegressor reg;
+        reg.setCovFunction(std::make_shared<ThinPlate>(2.0));
+        Model::Ptr gp = std::make_shared<Model>();
+        gp->factorization = factorization;
+        reg.create<false>(data, gp);
+        std::vector<double> mu, v;
+        const double log_lik = reg.leaveOneOut(gp, mu, v);
+
+        double err_mu(0.0), err_v(0.0), log_lik_refit(0.0);
+        for (std::size_t i = 0; i < data->label.size(); ++i)
+        {
+                Data::Ptr rest = std::make_shared<Data>(*data);
+                rest->coord_x.erase(rest->coord_x.begin() + i);
+                rest->coord_y.erase(rest->coord_y.begin() + i);
+                rest->coord_z.erase(rest->coord_z.begin() + i);
+                rest->label.erase(rest->label.begin() + i);
+                rest->sigma2.erase(rest->sigma2.begin() + i);
+                Data::Ptr query = std::make_shared<Data>();
+                query->coord_x.push_back(data->coord_x[i]);
+                query->coord_y.push_back(data->coord_y[i]);
+                query->coord_z.push_back(data->coord_z[i]);
+                Model::Ptr refit;
+                reg.create<false>(rest, refit);
+                std::vector<double> f, fv;
+                reg.evaluate(refit, query, f, fv);
+                // the held out label is noisy
+                const double var = fv[0] + data->sigma2[i];
+                err_mu = std::max(err_mu, std::abs(f[0] - mu[i]));
+                err_v = std::max(err_v, std::abs(var - v[i]) / var);
+                log_lik_refit += -0.5*std::log(2*M_PI*var) - 0.5*std::pow(data->label[i] - f[0], 2)/var;
+        }
+        std::cout << "mean " << err_mu << " variance " << err_v << " log likelihood "
+                  << log_lik << " (refits " << log_lik_refit << ")" << std::endl;
+        return err_mu < 1e-6 && err_v < 1e-6 && std::abs(log_lik - log_lik_refit) < 1e-6*(1 + std::abs(log_lik));
+}
+
+int main()
+{
+        bool ok = check(Factorization::LDLT);
+        ok &= check(Factorization::BLOCKED_LDLT);
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+// the split mean and gradient against the plain sums over Kqp, relative to
+// the size of the summed terms, which is what cancellation is measured against
+bool checkScale(const ThinPlate &kernel, const Model &gp, const double scale)
+{
+        Eigen::MatrixXd Q = scale*Eigen::MatrixXd::Random(200, 3);
+        Eigen::MatrixXd D(Q.rows(), gp.P.rows());
+        for (int i = 0; i < Q.rows(); ++i)
+                D.row(i) = (gp.P.rowwise() - Q.row(i)).rowwise().norm().transpose();
+
+        Eigen::VectorXd F;
+        Eigen::MatrixXd N;
+        MeanEvaluator<ThinPlate>::evaluate(kernel, gp.alpha, gp.P, gp.moments, Q, D, &F, &N);
+
+        Eigen::MatrixXd Kqp(D.rows(), D.cols()), W(D.rows(), D.cols());
+        for (int i = 0; i < D.rows(); ++i)
+                for (int j = 0; j < D.cols(); ++j)
+                {
+                        Kqp(i, j) = kernel.compute(D(i, j));
+                        W(i, j) = kernel.computediff(D(i, j)) * gp.alpha(j);
+                }
+        const Eigen::VectorXd F_ref = Kqp*gp.alpha;
+        Eigen::MatrixXd N_ref = W.rowwise().sum().asDiagonal() * Q;
+        N_ref -= W*gp.P;
+        const Eigen::VectorXd F_size = Kqp.cwiseAbs()*gp.alpha.cwiseAbs();
+        const Eigen::VectorXd N_size = W.cwiseAbs().rowwise().sum().cwiseProduct(Q.rowwise().norm()) +
+                W.cwiseAbs()*gp.P.rowwise().norm();
+
+        double err_f(0.0), err_n(0.0);
+        for (int i = 0; i < Q.rows(); ++i)
+        {
+                err_f = std::max(err_f, std::abs(F(i) - F_ref(i)) / F_size(i));
+                err_n = std::max(err_n, (N.row(i) - N_ref.row(i)).norm() / N_size(i));
+        }
+        std::cout << "queries within " << scale << ": mean " << err_f << " gradient " << err_n << std::endl;
+        return err_f < 1e-10 && err_n < 1e-10;
+}
+
+int main()
+{
+        Data::Ptr data = generateData(300, 40);
+        ThinPlateRegressor reg;
+        std::shared_ptr<ThinPlate> kernel = std::make_shared<ThinPlate>(2.0);
+        reg.setCovFunction(kernel);
+        Model::Ptr gp;
+        reg.create<false>(data, gp);
+
+        // the training cloud is within 2, query inside it and far outside
+        bool ok = true;
+        for (const double scale : {0.5, 2.0, 10.0, 100.0, 1000.0})
+                ok &= checkScale(*kernel, *gp, scale);
+
+        // the moments follow the model through update()
+        Data::Ptr more = generateData(20, 0);
+        reg.update<false>(more, gp);
+        AlphaMoments m;
+        MeanEvaluator<ThinPlate>::precompute(gp->alpha, gp->P, m);
+        const double err = std::abs(m.sum - gp->moments.sum) + (m.P - gp->moments.P).norm() +
+                std::abs(m.P2 - gp->moments.P2);
+        std::cout << "moments after update " << err << std::endl;
+        ok &= err < 1e-10;
+        ok &= checkScale(*kernel, *gp, 100.0);
+
+        // through the regressor the mean alone takes the split, with the
+        // variance it comes from Kqp
+        Data::Ptr query = std::make_shared<Data>();
+        for (int i = 0; i < 100; ++i)
+        {
+                const double scale = i < 50 ? 1.0 : 50.0;
+                query->coord_x.push_back(scale*getRandIn(-1.0, 1.0));
+                query->coord_y.push_back(scale*getRandIn(-1.0, 1.0));
+                query->coord_z.push_back(scale*getRandIn(-1.0, 1.0));
+        }
+        EvalOutput fast, full;
+        reg.evaluate<EVAL_MEAN>(gp, query, fast);
+        reg.evaluate<EVAL_MEAN | EVAL_VAR>(gp, query, full);
+        double err_reg(0.0);
+        for (std::size_t i = 0; i < fast.f.size(); ++i)
+                err_reg = std::max(err_reg, std::abs(fast.f[i] - full.f[i]) / (1.0 + std::abs(full.f[i])));
+        std::cout << "regressor, split vs Kqp mean " << err_reg << std::endl;
+        ok &= err_reg < 1e-8;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <gp_regression/model_buffer.hpp>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+int main()
+{
+        const int n0 = 200, k = 10, rebuilds = 8;
+        ThinPlateRegressor::Ptr reg = std::make_shared<ThinPlateRegressor>();
+        reg->setCovFunction(std::make_shared<ThinPlate>(2.0));
+        Data::Ptr data = generateData(n0, 30);
+        std::vector<Data::Ptr> more;
+        for (int i = 0; i < rebuilds; ++i)
+                more.push_back(generateData(k, 0));
+        Data::Ptr query = generateData(20, 0);
+        query->label.clear();
+        query->sigma2.clear();
+
+        ModelBuffer buffer;
+        bool ok = !buffer.get() && buffer.version() == 0 && !buffer.isBuilding();
+        Model::Ptr gp;
+        reg->create<false>(data, gp);
+        ok &= buffer.publish(gp) == 1;
+        const int rows0 = gp->P.rows();
+
+        // readers take snapshots while the models are rebuilt: versions only
+        // grow and every snapshot is the model of its version, also once newer
+        // ones are published
+        std::atomic<bool> done(false);
+        std::atomic<int> reader_errors(0);
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 3; ++t)
+                readers.emplace_back([&]()
+                {
+                        std::vector<ModelSnapshot::ConstPtr> kept;
+                        std::size_t last = 0;
+                        while (!done)
+                        {
+                                ModelSnapshot::ConstPtr s = buffer.snapshot();
+                                if (s->version < last || !s->model ||
+                                    s->model->P.rows() != rows0 + k*static_cast<int>(s->version - 1))
+                                        ++reader_errors;
+                                last = s->version;
+                                if (kept.empty() || kept.back()->version != s->version)
+                                        kept.push_back(s);
+                                EvalOutput out;
+                                reg->evaluate<EVAL_MEAN>(s->model, query, out);
+                                if (out.f.size() != query->coord_x.size())
+                                        ++reader_errors;
+                        }
+                        for (const ModelSnapshot::ConstPtr &s : kept)
+                                if (s->model->P.rows() != rows0 + k*static_cast<int>(s->version - 1))
+                                        ++reader_errors;
+                });
+
+        // the first build waits, so the buffer is seen building
+        std::atomic<bool> go(false);
+        for (int i = 0; i < rebuilds; ++i)
+        {
+                const Data::Ptr fresh = more[i];
+                buffer.rebuild([&, fresh, i](Model::ConstPtr current)
+                {
+                        while (i == 0 && !go)
+                                std::this_thread::yield();
+                        Model::Ptr next = std::make_shared<Model>(*current);
+                        reg->update<false>(fresh, next);
+                        return next;
+                });
+                // failing and empty builds leave the current model published
+                if (i == 2)
+                        buffer.rebuild([](Model::ConstPtr) -> Model::Ptr
+                        {
+                                throw GPRegressionException("failing on purpose");
+                        });
+                if (i == 4)
+                        buffer.rebuild([](Model::ConstPtr) { return Model::Ptr(); });
+        }
+        ok &= buffer.isBuilding() && buffer.version() == 1;
+        go = true;
+        buffer.wait();
+        ok &= !buffer.isBuilding();
+        std::cout << "version after the rebuilds " << buffer.version() << std::endl;
+        ok &= buffer.version() == 1 + rebuilds && buffer.get()->P.rows() == rows0 + k*rebuilds;
+        done = true;
+        for (std::thread &t : readers)
+                t.join();
+        std::cout << "reader errors " << reader_errors << std::endl;
+        ok &= reader_errors == 0;
+
+        // reset publishes an empty model, an old snapshot is still usable
+        ModelSnapshot::ConstPtr old = buffer.snapshot();
+        buffer.reset();
+        ok &= !buffer.get() && buffer.version() == 2 + rebuilds;
+        EvalOutput out;
+        reg->evaluate<EVAL_MEAN>(old->model, query, out);
+        ok &= out.f.size() == query->coord_x.size() && old->model->P.rows() == rows0 + k*rebuilds;
+
+        // and building starts again from empty
+        buffer.rebuild([&](Model::ConstPtr current)
+        {
+                Model::Ptr next;
+                if (!current)
+                        reg->create<false>(data, next);
+                return next;
+        });
+        buffer.wait();
+        ok &= buffer.get() && buffer.get()->P.rows() == rows0 && buffer.version() == 3 + rebuilds;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
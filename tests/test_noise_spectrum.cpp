@@ -0,0 +1,104 @@
+#include <iostream>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+template <typename Regressor>
+double maxDifference(const Regressor &reg, Model::ConstPtr a, Model::ConstPtr b, Data::ConstPtr query)
+{
+        EvalOutput out_a, out_b;
+        reg.template evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(a, query, out_a);
+        reg.template evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(b, query, out_b);
+        double err = (out_a.N - out_b.N).cwiseAbs().maxCoeff();
+        for (std::size_t i = 0; i < out_a.f.size(); ++i)
+                err = std::max(err, std::abs(out_a.f[i] - out_b.f[i]) + std::abs(out_a.v[i] - out_b.v[i]));
+        return err;
+}
+
+int main()
+{
+        Data::Ptr data = generateData(250, 40, 1e-1);
+        Data::Ptr query = generateData(60, 0, 0.0);
+        query->label.clear();
+        query->sigma2.clear();
+        const std::vector<double> noises = {1e-2, 5e-2, 1e-1, 0.3, 1.0};
+
+        // every noise level from one decomposition, as a create per level
+        ThinPlateRegressor reg;
+        reg.setCovFunction(std::make_shared<ThinPlate>(2.5));
+        Model::Ptr gp = std::make_shared<Model>();
+        gp->factorization = Factorization::EIGEN;
+        reg.create<false>(data, gp);
+        bool ok = gp->factorization == Factorization::EIGEN;
+        double err = 0.0;
+        for (const double s2 : noises)
+        {
+                reg.setNoise(gp, s2);
+                for (double &s : data->sigma2)
+                        s = s2;
+                Model::Ptr reference;
+                reg.create<false>(data, reference);
+                err = std::max(err, maxDifference(reg, gp, reference, query));
+                err = std::max(err, (gp->Kpp - reference->Kpp).cwiseAbs().maxCoeff());
+        }
+        std::cout << "noise sweep " << err << std::endl;
+        ok &= err < 1e-6;
+
+        // and updates, with the same noise, keep the spectrum
+        Data::Ptr more = generateData(20, 5, 1.0);
+        Model::Ptr reference;
+        reg.create<false>(data, reference);
+        reg.update<false>(more, gp);
+        reg.update<false>(more, reference);
+        err = maxDifference(reg, gp, reference, query);
+        std::cout << "update " << err << std::endl;
+        ok &= err < 1e-6 && gp->factorization == Factorization::EIGEN;
+
+        // log marginal likelihood against a factorization per level
+        GaussianRegressor gauss;
+        gauss.setCovFunction(std::make_shared<Gaussian>(1.0, 0.5));
+        Model::Ptr gp_gauss = std::make_shared<Model>();
+        gp_gauss->factorization = Factorization::EIGEN;
+        gauss.create<false>(data, gp_gauss);
+        std::vector<double> log_lik;
+        gauss.logLikelihood(gp_gauss, noises, log_lik);
+        err = 0.0;
+        for (std::size_t i = 0; i < noises.size(); ++i)
+        {
+                Eigen::MatrixXd K = gp_gauss->Kpp;
+                K.diagonal().array() += noises[i] - gp_gauss->S2(0);
+                const Eigen::LLT<Eigen::MatrixXd> llt(K);
+                const Eigen::MatrixXd L = llt.matrixL();
+                const double expected = -0.5*gp_gauss->Y.dot(llt.solve(gp_gauss->Y))
+                        - L.diagonal().array().log().sum() - 0.5*K.rows()*std::log(2*M_PI);
+                err = std::max(err, std::abs(log_lik[i] - expected)/(1.0 + std::abs(expected)));
+        }
+        std::cout << "log likelihood " << err << std::endl;
+        ok &= err < 1e-8;
+
+        // heteroscedastic noise falls back to LDLT
+        data->sigma2[0] = 0.5;
+        Model::Ptr hetero = std::make_shared<Model>();
+        hetero->factorization = Factorization::EIGEN;
+        reg.create<false>(data, hetero);
+        ok &= hetero->factorization == Factorization::LDLT;
+        bool thrown = false;
+        try
+        {
+                reg.setNoise(hetero, 1e-1);
+        }
+        catch (const GPRegressionException &)
+        {
+                thrown = true;
+        }
+        ok &= thrown;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <random_generation.hpp>
+
+std::vector<double> draw(const std::size_t n)
+{
+        std::vector<double> x(n);
+        for (auto &v : x)
+                v = getRandIn(0.0, 1.0);
+        return x;
+}
+
+// draws of workers pinned to streams 1..workers
+std::vector<std::vector<double>> drawWorkers(const std::size_t workers, const std::size_t n)
+{
+        std::vector<std::vector<double>> x(workers);
+        std::vector<std::thread> pool;
+        for (std::size_t i = 0; i < workers; ++i)
+                pool.emplace_back([&x, i, n]()
+                {
+                        setRandomStream(i + 1);
+                        x[i] = draw(n);
+                });
+        for (auto &t : pool)
+                t.join();
+        return x;
+}
+
+int main()
+{
+        // the same seed gives the same draws, on every stream
+        setRandomSeed(7);
+        setRandomStream(0);
+        const std::vector<double> a = draw(100);
+        const std::vector<std::vector<double>> wa = drawWorkers(4, 100);
+        setRandomSeed(7);
+        const std::vector<double> b = draw(100);
+        const std::vector<std::vector<double>> wb = drawWorkers(4, 100);
+        bool ok = a == b && wa == wb;
+
+        // and the streams are not the same
+        for (std::size_t i = 0; i < wa.size(); ++i)
+        {
+                ok &= wa[i] != a;
+                for (std::size_t j = 0; j < i; ++j)
+                        ok &= wa[i] != wa[j];
+        }
+
+        // another seed, other draws
+        setRandomSeed(8);
+        ok &= draw(100) != a;
+
+        // van der Corput points
+        ok &= halton(1, 2) == 0.5 && halton(2, 2) == 0.25 && halton(3, 2) == 0.75;
+        ok &= std::abs(halton(1, 3) - 1.0/3) < 1e-15 && std::abs(halton(4, 3) - 4.0/9) < 1e-15;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+double maxDifference(const EvalOutput &a, const EvalOutput &b)
+{
+        double err = a.f.size() == b.f.size() && a.v.size() == b.v.size() ? 0.0 : 1e10;
+        for (std::size_t i = 0; i < a.f.size() && i < b.f.size(); ++i)
+                err = std::max(err, std::abs(a.f[i] - b.f[i]));
+        for (std::size_t i = 0; i < a.v.size() && i < b.v.size(); ++i)
+                err = std::max(err, std::abs(a.v[i] - b.v[i]));
+        return err;
+}
+
+// a field refreshed after each of two updates is the field evaluated afresh
+bool checkRefresh(const bool spatial_order)
+{
+        Data::Ptr data = generateData(300, 40);
+        Data::Ptr query = generateData(150, 0);
+        query->label.clear();
+        query->sigma2.clear();
+
+        ThinPlateRegressor reg;
+        reg.setCovFunction(std::make_shared<ThinPlate>(2.0));
+        Model::Ptr gp = std::make_shared<Model>();
+        gp->spatial_order = spatial_order;
+        reg.create<false>(data, gp);
+
+        EvalOutput field, mean_only;
+        reg.evaluate<EVAL_MEAN | EVAL_VAR>(gp, query, field);
+        reg.evaluate<EVAL_MEAN>(gp, query, mean_only);
+        // an unknown variance stays unknown
+        field.v[0] = std::numeric_limits<double>::quiet_NaN();
+
+        bool ok = true;
+        for (int round = 0; round < 2; ++round)
+        {
+                reg.update<false>(generateData(15, round), gp);
+                reg.refresh(gp, query, field);
+                reg.refresh(gp, query, mean_only);
+
+                EvalOutput fresh, fresh_mean;
+                reg.evaluate<EVAL_MEAN | EVAL_VAR>(gp, query, fresh);
+                reg.evaluate<EVAL_MEAN>(gp, query, fresh_mean);
+                ok &= std::isnan(field.v[0]);
+                field.v[0] = fresh.v[0];
+                const double err = maxDifference(field, fresh);
+                const double err_mean = maxDifference(mean_only, fresh_mean);
+                field.v[0] = std::numeric_limits<double>::quiet_NaN();
+                std::cout << (spatial_order ? "sorted" : "input order") << ", update " << round + 1
+                          << ": mean and variance " << err << ", mean only " << err_mean << std::endl;
+                ok &= err < 1e-8 && err_mean < 1e-8;
+        }
+        return ok;
+}
+
+int main()
+{
+        bool ok = checkRefresh(false);
+        ok &= checkRefresh(true);
+
+        // refresh needs an update to correct for
+        Data::Ptr data = generateData(100, 20);
+        Data::Ptr query = generateData(10, 0);
+        query->label.clear();
+        query->sigma2.clear();
+        ThinPlateRegressor reg;
+        reg.setCovFunction(std::make_shared<ThinPlate>(2.0));
+        Model::Ptr gp;
+        reg.create<false>(data, gp);
+        EvalOutput field;
+        reg.evaluate<EVAL_MEAN>(gp, query, field);
+        try
+        {
+                reg.refresh(gp, query, field);
+                ok = false;
+        }
+        catch (const GPRegressionException &)
+        {
+        }
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
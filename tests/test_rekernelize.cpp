@@ -0,0 +1,79 @@
+#include <iostream>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+double maxDifference(const ThinPlateRegressor &reg, Model::ConstPtr a, Model::ConstPtr b, Data::ConstPtr query)
+{
+        EvalOutput out_a, out_b;
+        reg.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(a, query, out_a);
+        reg.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(b, query, out_b);
+        double err = (out_a.N - out_b.N).cwiseAbs().maxCoeff();
+        for (std::size_t i = 0; i < out_a.f.size(); ++i)
+                err = std::max(err, std::abs(out_a.f[i] - out_b.f[i]) + std::abs(out_a.v[i] - out_b.v[i]));
+        return err;
+}
+
+int main()
+{
+        Data::Ptr data = generateData(300, 40);
+        Data::Ptr more = generateData(25, 0);
+        Data::Ptr query = generateData(50, 0);
+        query->label.clear();
+        query->sigma2.clear();
+
+        ThinPlateRegressor reg, wider;
+        reg.setCovFunction(std::make_shared<ThinPlate>(2.0));
+        wider.setCovFunction(std::make_shared<ThinPlate>(3.0));
+
+        Model::Ptr gp = std::make_shared<Model>();
+        gp->cache_distances = true;
+        reg.create<true>(data, gp);
+        reg.update<false>(more, gp);
+
+        // the cache is kept up to date by update()
+        Model::Ptr fresh;
+        reg.create<false>(data, fresh);
+        reg.update<false>(more, fresh);
+        Eigen::MatrixXd D = (gp->P * gp->P.transpose() * -2.0);
+        D.colwise() += gp->P.rowwise().squaredNorm();
+        D.rowwise() += gp->P.rowwise().squaredNorm().transpose();
+        double err = (D.array().max(0.0).sqrt().matrix() - gp->Dpp).cwiseAbs().maxCoeff();
+        err = std::max(err, std::abs(gp->R - gp->Dpp.maxCoeff()));
+        std::cout << "cached distances " << err << std::endl;
+        bool ok = err < 1e-9;
+
+        // another R, from the cached distances, as a full create with it
+        wider.rekernelize<true>(gp);
+        Model::Ptr reference;
+        Data::Ptr all = std::make_shared<Data>(*data);
+        all->coord_x.insert(all->coord_x.end(), more->coord_x.begin(), more->coord_x.end());
+        all->coord_y.insert(all->coord_y.end(), more->coord_y.begin(), more->coord_y.end());
+        all->coord_z.insert(all->coord_z.end(), more->coord_z.begin(), more->coord_z.end());
+        all->label.insert(all->label.end(), more->label.begin(), more->label.end());
+        all->sigma2.insert(all->sigma2.end(), more->sigma2.begin(), more->sigma2.end());
+        wider.create<true>(all, reference);
+        err = maxDifference(wider, gp, reference, query);
+        err = std::max(err, (gp->N - reference->N).cwiseAbs().maxCoeff());
+        std::cout << "kernel change " << err << std::endl;
+        ok &= err < 1e-8 && gp->last_update.p == 0;
+
+        // another noise
+        gp->S2.setConstant(1e-2);
+        wider.rekernelize<false>(gp);
+        for (double &s2 : all->sigma2)
+                s2 = 1e-2;
+        wider.create<false>(all, reference);
+        err = maxDifference(wider, gp, reference, query);
+        std::cout << "noise change " << err << std::endl;
+        ok &= err < 1e-8;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+#include "sphere_data.hpp"
+
+using namespace gp_regression;
+
+double maxDifference(const EvalOutput &a, const EvalOutput &b)
+{
+        double err = (a.N - b.N).cwiseAbs().maxCoeff() + (a.Tx - b.Tx).cwiseAbs().maxCoeff();
+        for (std::size_t i = 0; i < a.f.size(); ++i)
+                err = std::max(err, std::abs(a.f[i] - b.f[i]) + std::abs(a.v[i] - b.v[i])
+                                + (a.H[i] - b.H[i]).cwiseAbs().maxCoeff());
+        return err;
+}
+
+int main()
+{
+        const unsigned all = EVAL_MEAN | EVAL_VAR | EVAL_TANGENTS | EVAL_HESSIAN;
+        Data::Ptr data = generateData(400, 50);
+        Data::Ptr more = generateData(30, 0);
+        Data::Ptr query = generateData(100, 0);
+        query->label.clear();
+        query->sigma2.clear();
+
+        // the curve really groups neighbours: consecutive points are closer
+        Eigen::MatrixXd P(data->label.size(), 3);
+        for (int i = 0; i < P.rows(); ++i)
+                P.row(i) << data->coord_x[i], data->coord_y[i], data->coord_z[i];
+        const std::vector<int> order = spatialOrder(P);
+        double step_input(0.0), step_sorted(0.0);
+        for (int i = 1; i < P.rows(); ++i)
+        {
+                step_input += (P.row(i) - P.row(i - 1)).norm();
+                step_sorted += (P.row(order[i]) - P.row(order[i - 1])).norm();
+        }
+        std::cout << "mean step, input " << step_input / P.rows() << " sorted " << step_sorted / P.rows() << std::endl;
+        bool ok = step_sorted < 0.5*step_input;
+
+        ThinPlateRegressor plain, sorting;
+        plain.setCovFunction(std::make_shared<ThinPlate>(2.0));
+        sorting.setCovFunction(std::make_shared<ThinPlate>(2.0));
+        sorting.setQueryOrdering(true);
+        Model::Ptr gp = std::make_shared<Model>();
+        Model::Ptr gp_sorted = std::make_shared<Model>();
+        gp_sorted->spatial_order = true;
+        plain.create<false>(data, gp);
+        sorting.create<false>(data, gp_sorted);
+        plain.update<false>(more, gp);
+        sorting.update<false>(more, gp_sorted);
+
+        // same answers, in the caller order
+        EvalOutput out, out_sorted;
+        plain.evaluate<all>(gp, query, out);
+        sorting.evaluate<all>(gp_sorted, query, out_sorted);
+        double err = maxDifference(out, out_sorted);
+        std::vector<double> mu, v, mu_sorted, v_sorted;
+        const double lik = plain.leaveOneOut(gp, mu, v);
+        const double lik_sorted = sorting.leaveOneOut(gp_sorted, mu_sorted, v_sorted);
+        err = std::max(err, std::abs(lik - lik_sorted));
+        for (std::size_t i = 0; i < mu.size(); ++i)
+                err = std::max(err, std::abs(mu[i] - mu_sorted[i]) + std::abs(v[i] - v_sorted[i]));
+        std::cout << "sorted vs input order " << err << std::endl;
+        ok &= err < 1e-8;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <gp_regression/gp_regressors.h>
+#include <random_generation.hpp>
+
+using namespace gp_regression;
+
+// lookups stay within the bound measured at construction, inside and beyond
+// the range of the tables; the bound on the derivative is on k' = r*computediff
+template <typename CovType>
+bool checkKernel(const CovType &k, const double R, const std::string &name)
+{
+        const Tabulated<CovType> t(k, R);
+        const Eigen::ArrayXd r = Eigen::ArrayXd::LinSpaced(10001, 0.0, 1.5*R);
+        const Eigen::ArrayXd K = t.computeArray(r);
+        const Eigen::ArrayXd Kd = t.computediffArray(r);
+        double err(0.0);
+        for (int i = 0; i < r.size(); ++i)
+        {
+                err = std::max(err, std::abs(K(i) - k.compute(r(i))));
+                err = std::max(err, r(i)*std::abs(Kd(i) - k.computediff(r(i))));
+                err = std::max(err, std::abs(K(i) - t.compute(r(i))) + std::abs(Kd(i) - t.computediff(r(i))));
+        }
+        std::cout << name << ": error " << err << " bound " << t.error() << std::endl;
+        return err <= 1.1*t.error() && t.error() < 1e-9;
+}
+
+int main()
+{
+        bool ok = checkKernel(Gaussian(1.0, 0.5), 3.0, "Gaussian");
+        ok &= checkKernel(Laplace(1.0, 0.5), 3.0, "Laplace");
+
+        // an unreachable tolerance is refused
+        try
+        {
+                Tabulated<Gaussian> t(Gaussian(), 1.0, 1e-20, 1024);
+                ok = false;
+        }
+        catch (const GPRegressionException &e)
+        {
+                std::cout << e.what() << std::endl;
+        }
+
+        // through the regressor, on a sphere
+        Data::Ptr data = std::make_shared<Data>();
+        Data::Ptr query = std::make_shared<Data>();
+        for (std::size_t i = 0; i < 300; ++i)
+        {
+                Data::Ptr d = i < 250 ? data : query;
+                const double th = getRandIn(0.0, 2*M_PI);
+                const double ph = std::acos(getRandIn(-1.0, 1.0, true));
+                d->coord_x.push_back(0.5*std::sin(ph)*std::cos(th));
+                d->coord_y.push_back(0.5*std::sin(ph)*std::sin(th));
+                d->coord_z.push_back(0.5*std::cos(ph));
+                if (i < 250)
+                {
+                        data->label.push_back(std::cos(ph));
+                        data->sigma2.push_back(1e-2);
+                }
+        }
+        GPRegressor<Gaussian> exact;
+        exact.setCovFunction(std::make_shared<Gaussian>(1.0, 0.5));
+        GPRegressor<Tabulated<Gaussian>> tabulated;
+        tabulated.setCovFunction(std::make_shared<Tabulated<Gaussian>>(Gaussian(1.0, 0.5), 1.0));
+        Model::Ptr gp_exact, gp_tabulated;
+        exact.create<false>(data, gp_exact);
+        tabulated.create<false>(data, gp_tabulated);
+        EvalOutput out_exact, out_tabulated;
+        exact.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(gp_exact, query, out_exact);
+        tabulated.evaluate<EVAL_MEAN | EVAL_VAR | EVAL_GRAD>(gp_tabulated, query, out_tabulated);
+        double err = (out_exact.N - out_tabulated.N).cwiseAbs().maxCoeff();
+        for (std::size_t i = 0; i < out_exact.f.size(); ++i)
+                err = std::max(err, std::abs(out_exact.f[i] - out_tabulated.f[i]) + std::abs(out_exact.v[i] - out_tabulated.v[i]));
+        std::cout << "regressor: " << err << std::endl;
+        ok &= err < 1e-5;
+
+        std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+}